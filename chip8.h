@@ -1,89 +1,341 @@
-/* Chip 8 Emulator  <chip8.h>
-Copyright (C) <2018>  <Bandit>
-
-This program is free software: you can redistribute it and/or modify
-it under the terms of the GNU General Public License as published by
-the Free Software Foundation, either version 3 of the License, or
-(at your option) any later version.
-
-This program is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the GNU General Public License
-along with this program.  If not, see <https://www.gnu.org/licenses/>. 
-*/
-#pragma once
-
-#include <cassert>
-
-#define MEMORY_SIZE         4096        //chip 8 vm only has 4k
-#define CPU_GPR_COUNT       16
-#define GFX_BUFFER_SIZE     64 * 32     //Buffer Array
-#define MAX_FILENAME_LEN    256
-
-#define BASE_RAM_OFFSET     0x200       //lowest ram offset for program use
-#define UPPER_RAM_OFFSET    0xE9F       //highest ram offset available to program
-#define SIZE_OF_RAM         (UPPER_RAM_OFFSET - BASE_RAM_OFFSET)
-#define BASE_FONT_OFFSET    0x050
-
-#define BASE_STACK_OFFSET   0xEA0
-#define UPPER_STACK_OFFSET  0xEFF
-
-#define STATUS_SUCCESS 0
-#define ERR_UNABLE_OPEN_FILE        -20
-#define ERR_CORRUPTED_ROM           -21
-#define ERR_ROM_GREATER_THAN_RAM    -22
-#define ERR_INVALID_OPCODE          -30
-
-typedef unsigned short int ushort;
-
-class CHIP8_EMULATOR
-{
-    public:
-    CHIP8_EMULATOR();
-    ~CHIP8_EMULATOR();
-
-    int initEmulator();                                 //initializes emulator to fresh state after "xxReset"
-    int resetEmulator();                                //unload ROM and reset GPRs & instruction pointer
-    int emulatorTick();                                 //Perform a fetch/execute/decode emulator cycle
-    ushort fetchInstruction();                          //fetches the instruction at the pc(program counter)/instruction pointer
-    int decodeAndExecuteInstruction(ushort opcode);
-    //int executeInstruction()
-
-    int loadROM(char filename[MAX_FILENAME_LEN]);       //loads ROM file into memory
-    void positionPC();                                  //moves the PC to point to the start of RAM for execution
-    int incrementPC(ushort offset = 1);                 //increments the program counter
-    int setPC(ushort address);
-    void pushAddrToStack(ushort address);               //pushes return address onto the stack
-    ushort popAddrFromStack();                          //pops address off the stack
-
-    ushort getSizeOfLoadedROM();                        //returns the number of bytes taken up by the currently loaded ROM
-    ushort* logicalAddressToPhysical(ushort logicalAddr, ushort base = BASE_RAM_OFFSET);
-    ushort physicalAddressToLogical(ushort *physicalAddr);
-
-
-    private:
-    ushort *programCounter;
-    ushort indexRegister;
-    unsigned char v[CPU_GPR_COUNT];                     //General purpose registers
-    unsigned char memory[MEMORY_SIZE];                  //this holds the entirety of the emulator's memory
-    unsigned char graphics[GFX_BUFFER_SIZE];
-    unsigned char delayTimer;                           //counts down @60hz
-    unsigned char soundTimer;                           //counts down @60hz
-    ushort *sb;
-    ushort *sp;
-    bool isRomLoaded;                                   //whether a ROM is currently loaded into emulator RAM
-    static bool isRNGSeeded;                            //whether pseudo-random number generator has been seeded. (init to false per c++ standard)
-    ushort sizeOfROM;
-};
-
-
-
-/*
-System Memory Map:
-0x000-0x1FF - Chip 8 interpreter (contains font set in emu)
-0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
-0x200-0xFFF - Program ROM and work RAM 
+/* Chip 8 Emulator  <chip8.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+*/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "chip8_memory.h"                               //MEMORY_SIZE and the paged copy-on-write address space
+
+#ifdef CHIP8_ENABLE_TRACE                               //build with TRACE=1 to get a per-instruction log on stderr
+#include <iostream>
+#define CHIP8_TRACE(msg)    (std::cerr << msg << std::endl)
+#else
+#define CHIP8_TRACE(msg)    ((void)0)
+#endif
+
+#define CPU_GPR_COUNT       16
+#define GFX_WIDTH           64          //lo-res display, one uint64_t per framebuffer row, bit 63 is the leftmost pixel
+#define GFX_HEIGHT          32
+#define HIRES_GFX_WIDTH     128         //SUPER-CHIP/XO-CHIP hi-res display, two words per row (left and right half)
+#define HIRES_GFX_HEIGHT    64
+#define GFX_PLANE_COUNT     2           //XO-CHIP bitplanes, a pixel's color is its plane 0 bit plus twice its plane 1 bit
+#define GFX_BUFFER_SIZE     (HIRES_GFX_WIDTH * HIRES_GFX_HEIGHT)    //size of the byte-per-pixel view, fits either resolution
+#define FONT_GLYPH_SIZE     5           //bytes per 4x5 font character
+#define BIG_FONT_GLYPH_SIZE 10          //bytes per 8x10 SUPER-CHIP font character
+#define RPL_FLAG_COUNT      16          //SUPER-CHIP user flags (FX75/FX85), XO-CHIP allows all 16
+#define AUDIO_PATTERN_SIZE  16          //XO-CHIP 128 sample 1-bit audio pattern (F002)
+#define TIMER_FREQUENCY     60          //delay and sound timer ticks per second
+#define MAX_FILENAME_LEN    256
+
+#define BASE_RAM_OFFSET     0x200       //lowest ram offset for program use
+#define UPPER_RAM_OFFSET    0xE9F       //highest ram offset available to program
+#define SIZE_OF_RAM         (UPPER_RAM_OFFSET - BASE_RAM_OFFSET)
+#define BASE_FONT_OFFSET    0x050
+#define BIG_FONT_OFFSET     0x0A0       //SUPER-CHIP digits, right after the small font
+
+#define STACK_DEPTH         16          //return addresses the call stack holds, one more call traps
+
+#define STATUS_SUCCESS 0
+#define STATUS_IDLE_LOOP            1           //not an error: handler hit a possible idle loop, runInstructions()/runBlocks() consume it
+#define STATUS_PROGRAM_EXIT         2           //not an error: SUPER-CHIP 00FD stopped the machine, the PC stays on it
+#define ERR_INVALID_ARGUMENT        -10
+#define ERR_UNABLE_OPEN_FILE        -20
+#define ERR_CORRUPTED_ROM           -21
+#define ERR_ROM_GREATER_THAN_RAM    -22
+#define ERR_UNSUPPORTED_ARCHIVE     -23         //archive member is encrypted or uses a compression other than deflate
+#define ERR_INVALID_OPCODE          -30
+#define ERR_STACK_OVERFLOW          -31         //2NNN with STACK_DEPTH calls outstanding, the PC stays on it
+#define ERR_STACK_UNDERFLOW         -32         //00EE with no call to return from, the PC stays on it
+#define ERR_DIFFERENTIAL_MISMATCH   -40
+#define ERR_INVALID_STATE           -50         //saved state blob is truncated, corrupted or from another version
+
+#define MAX_BLOCK_LENGTH    64          //most instructions translated into a single block
+#define IDLE_LOOP_MAX_LENGTH    16      //longest backward jump (in instructions) checked for an idle loop
+
+#define STATE_MAGIC         0x56533843  //"C8SV" little endian, first four bytes of a saved state
+#define STATE_VERSION       5           //2: key state, 3: quirks, 4: platform, hi-res/planes, RPL flags, audio pattern, 5: stack out of memory
+
+#define PLATFORM_CHIP8      0           //original instruction set, 64x32, 4 KB
+#define PLATFORM_SCHIP      1           //SUPER-CHIP 1.1: 128x64 hi-res, scrolling, 16x16 sprites, big font, RPL flags
+#define PLATFORM_XOCHIP     2           //XO-CHIP: SUPER-CHIP plus 64 KB of memory, two bitplanes and an audio pattern
+#define PLATFORM_COUNT      3
+
+//behavior that differs between CHIP-8 interpreters, 0 is what this emulator always did (see chip8_quirks.h for profiles)
+#define QUIRK_SHIFT_VY          0x01    //8XY6/8XYE shift VY into VX (COSMAC VIP), otherwise VX is shifted in place
+#define QUIRK_INDEX_MASK        0x06    //where FX55/FX65 leave I:
+#define QUIRK_INDEX_UNCHANGED   0x00    //  I untouched (SUPER-CHIP)
+#define QUIRK_INDEX_PLUS_X      0x02    //  I + X (CHIP-48)
+#define QUIRK_INDEX_PLUS_X1     0x04    //  I + X + 1 (COSMAC VIP)
+#define QUIRK_JUMP_VX           0x08    //BXNN jumps to XNN + VX (CHIP-48, SUPER-CHIP), otherwise BNNN jumps to NNN + V0
+#define QUIRK_VF_RESET          0x10    //8XY1/8XY2/8XY3 clear VF (COSMAC VIP)
+#define QUIRK_ALL               0x1F
+
+inline unsigned int chip8SeedToRNGState(unsigned long long seed)
+{   //splitmix64 finalizer spreads nearby seeds (0, 1, 2...) over the whole state space
+    seed += 0x9E3779B97F4A7C15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+    seed ^= seed >> 31;
+    return (unsigned int) seed | 1;  //xorshift state must never be zero
+}
+
+inline unsigned int chip8StepRNG(unsigned int state)
+{   //xorshift32, CXNN uses the top byte
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+class CHIP8_EMULATOR;
+struct DECODED_INSTRUCTION;
+struct CHIP8_ROM_IMAGE;
+class CHIP8_PROFILER;
+typedef int (CHIP8_EMULATOR::*OPCODE_HANDLER)(const DECODED_INSTRUCTION &instr);
+
+struct DECODED_INSTRUCTION                              //an opcode with its operand fields already pulled out
+{
+    OPCODE_HANDLER handler;                             //member that executes the instruction (NULL = slot not decoded yet)
+    ushort opcode;
+    ushort nnn;                                         //NNN: address
+    unsigned char nn;                                   //NN: 8-bit constant
+    unsigned char n;                                    //N: 4-bit constant
+    unsigned char x;                                    //X: 4-bit register identifier
+    unsigned char y;                                    //Y: 4-bit register identifier
+};
+
+struct TRANSLATED_BLOCK                                 //straight-line run of instructions ending at a jump/call/return/skip
+{
+    unsigned int length;                                //number of instructions in the block (0 = not translated)
+    unsigned int firstInstruction;                      //index of the first instruction in BLOCK_CACHE::instructions
+};
+
+struct BLOCK_CACHE                                      //everything runBlocks() keeps, allocated the first time a block runs
+{
+    std::vector<TRANSLATED_BLOCK> table;                //block starting at each address (one per byte of memory), indexed directly
+    std::vector<DECODED_INSTRUCTION> instructions;      //instructions of all translated blocks, back to back
+    std::vector<unsigned char> coverage;                //non-zero when the byte is part of a translated block
+    bool pendingFlush;                                  //a translated byte was written, flush before running another block
+};
+
+struct IDLE_PROBE                                      //machine state the last time a possible idle loop reached its head
+{
+    bool valid;
+    unsigned int pc;
+    unsigned long executed;                             //instruction count within the current run call
+    unsigned long long stateWrites;                     //CHIP8_EMULATOR::stateWrites at the time
+    unsigned int rngState;
+    ushort indexRegister;
+    ushort sp;
+    unsigned char v[CPU_GPR_COUNT];
+    unsigned char delayTimer;
+    unsigned char soundTimer;
+    ushort keyState;
+};
+
+class CHIP8_EMULATOR
+{
+    public:
+    CHIP8_EMULATOR();
+    CHIP8_EMULATOR(const CHIP8_EMULATOR &other);        //same as fork(), memory pages are shared copy-on-write
+    CHIP8_EMULATOR& operator=(const CHIP8_EMULATOR &other);
+    ~CHIP8_EMULATOR();
+
+    int initEmulator();                                 //initializes emulator to fresh state after "xxReset"
+    int resetEmulator();                                //unload ROM and reset GPRs & instruction pointer
+    int emulatorTick();                                 //Perform a fetch/execute/decode emulator cycle
+    int runInstructions(unsigned long budget, unsigned long *executedCount);   //interpreter loop, stops early on an error
+    ushort fetchInstruction();                          //fetches the instruction at the pc(program counter)/instruction pointer
+    int decodeAndExecuteInstruction(ushort opcode);
+    DECODED_INSTRUCTION decodeInstruction(ushort opcode);   //splits opcode into fields and picks its handler
+    bool isValidOpcode(ushort opcode);                  //whether the current platform decodes it to something other than an invalid opcode
+    void predecode(const std::vector<ushort> &addresses);   //fills the decode cache at these physical addresses ahead of execution
+    //int executeInstruction()
+    int executeBlock(unsigned int *executedCount);      //runs the translated block at the PC, translating it first if needed
+    int runBlocks(unsigned long budget, unsigned long *executedCount);  //runs whole blocks until at least budget instructions executed
+    void setDifferentialCheck(bool enabled);            //when enabled runBlocks() replays every block on the interpreter and compares
+    void copyMachineState(const CHIP8_EMULATOR &other); //copies registers, memory, stack and timers (not caches) from other
+    bool compareMachineState(const CHIP8_EMULATOR &other);  //returns true when both machines hold identical state
+    CHIP8_EMULATOR* fork();                             //new machine in the same state, unchanged memory pages stay shared
+    void saveState(std::vector<unsigned char> &out);    //appends a versioned snapshot of the whole machine (caches excluded)
+    int loadState(const unsigned char *data, size_t length);    //restores a saveState() blob, ERR_INVALID_STATE if it does not parse
+    void saveBaseline();                                //remembers the current state for restoreBaseline(), e.g. once a fuzz target is set up
+    void restoreBaseline();                             //back to the saveBaseline() state, only copying the memory pages and display rows written since
+
+    int loadROM(char filename[MAX_FILENAME_LEN]);       //loads ROM file (or archive:member) through the process-wide ROM cache
+    int loadROM(const CHIP8_ROM_IMAGE &image);          //memory becomes the image's font + ROM pages, shared until written
+    int loadROM(const unsigned char *data, unsigned int size);  //copies the bytes to BASE_RAM_OFFSET over what memory holds (fuzz inputs)
+    static void initMemory(CHIP8_MEMORY &memory);       //fresh address space: zeroes plus the font
+    void positionPC();                                  //moves the PC to point to the start of RAM for execution
+    int incrementPC(ushort offset = 1);                 //increments the program counter
+    int setPC(ushort address);
+    int pushAddrToStack(ushort address);                //pushes a return address, ERR_STACK_OVERFLOW when the stack is full
+    int popAddrFromStack(ushort *address);              //pops a return address, ERR_STACK_UNDERFLOW when the stack is empty
+
+    ushort getSizeOfLoadedROM();                        //returns the number of bytes taken up by the currently loaded ROM
+    void copyMemory(unsigned char *out);                //copies the whole address space (getMemorySize() bytes) into out
+    unsigned int getMemorySize();                       //MEMORY_SIZE, or XO_MEMORY_SIZE on XO-CHIP
+    ushort logicalAddressToPhysical(ushort logicalAddr, ushort base = BASE_RAM_OFFSET);
+    ushort physicalAddressToLogical(ushort physicalAddr);
+    unsigned long long getRegisterHash();               //FNV-1a over V0-VF, I, PC, the stack and the timers
+    unsigned long long getGraphicsHash();               //FNV-1a over the framebuffer
+    unsigned long long getStateHash();                  //registers, memory and framebuffer combined
+    unsigned long long getZobristHash(bool withRNG = true); //whole machine state, kept incrementally: costs about as much as a few instructions
+    void seedRNG(unsigned long long seed);              //makes CXNN reproducible for this machine
+    void setKeyState(ushort keys);                      //bit k set while key k (0-F) is held down
+    ushort getKeyState();
+    void tickTimers();                                  //one 60hz tick of the delay and sound timers, driven by the host
+    unsigned char getSoundTimer();                      //the beeper sounds while this is not 0
+    const unsigned char *getAudioPattern();             //AUDIO_PATTERN_SIZE bytes, XO-CHIP F002
+    unsigned char getAudioPitch();                      //XO-CHIP FX3A
+    void getPixelBuffer(unsigned char pixels[GFX_BUFFER_SIZE]);    //expands the packed framebuffer to one byte (color 0-3) per pixel, row by row
+    unsigned int getDisplayWidth();                     //GFX_WIDTH, or HIRES_GFX_WIDTH in hi-res mode
+    unsigned int getDisplayHeight();
+    uint64_t takeDirtyRows();                           //display rows (bit y = row y) changed since the last call, and clears them
+    void copyFrameRows(uint64_t dest[GFX_PLANE_COUNT][2][HIRES_GFX_HEIGHT], uint64_t rows);   //copies just the given rows of every plane
+    void writeMemory(ushort physicalAddr, unsigned char value); //every store to memory[] goes through here so the decode cache stays coherent
+    void invalidateDecodeCache();                       //drops every cached decode (e.g. after a ROM load)
+    void flushBlockCache();                             //drops every translated block
+    void setIdleSkip(bool enabled);                     //fast-forward loops that provably wait for a timer or key (on by default)
+    unsigned long long getIdleSkipCount();              //times a loop was fast-forwarded
+    unsigned long long getElidedInstructionCount();     //instructions counted as executed without running them
+    ushort getInvalidOpcode();                          //the opcode behind the last ERR_INVALID_OPCODE
+    void setProfiler(CHIP8_PROFILER *profiler);         //records guest execution into profiler (NULL = off), PROFILE=1 builds only
+    void setEdgeCoverage(unsigned char *counters);      //counts jumps, calls, returns and taken skips into FUZZ_EDGE_MAP_SIZE counters (NULL = off), FUZZ=1 builds only
+    int setQuirks(unsigned int quirks);                 //QUIRK_* mask, picks the specialized handlers from the next decode on
+    unsigned int getQuirks();
+    int setPlatform(unsigned int platform);             //PLATFORM_*, resizes memory and resets the display, call before loadROM()
+    unsigned int getPlatform();
+
+
+    private:
+    //handlers a quirk or the platform changes are templates: every variant is compiled separately, the decoder picks one per opcode
+    int op00E0(const DECODED_INSTRUCTION &instr);
+    int op00EE(const DECODED_INSTRUCTION &instr);
+    int op1NNN(const DECODED_INSTRUCTION &instr);
+    int op2NNN(const DECODED_INSTRUCTION &instr);
+    template<bool LONG_SKIP> int op3XNN(const DECODED_INSTRUCTION &instr);  //LONG_SKIP: XO-CHIP, F000 NNNN is skipped whole
+    template<bool LONG_SKIP> int op4XNN(const DECODED_INSTRUCTION &instr);
+    template<bool LONG_SKIP> int op5XY0(const DECODED_INSTRUCTION &instr);
+    int op6XNN(const DECODED_INSTRUCTION &instr);
+    int op7XNN(const DECODED_INSTRUCTION &instr);
+    int op8XY0(const DECODED_INSTRUCTION &instr);
+    template<bool VF_RESET> int op8XY1(const DECODED_INSTRUCTION &instr);
+    template<bool VF_RESET> int op8XY2(const DECODED_INSTRUCTION &instr);
+    template<bool VF_RESET> int op8XY3(const DECODED_INSTRUCTION &instr);
+    int op8XY4(const DECODED_INSTRUCTION &instr);
+    int op8XY5(const DECODED_INSTRUCTION &instr);
+    template<bool SHIFT_VY> int op8XY6(const DECODED_INSTRUCTION &instr);
+    int op8XY7(const DECODED_INSTRUCTION &instr);
+    template<bool SHIFT_VY> int op8XYE(const DECODED_INSTRUCTION &instr);
+    template<bool LONG_SKIP> int op9XY0(const DECODED_INSTRUCTION &instr);
+    int opANNN(const DECODED_INSTRUCTION &instr);
+    template<bool JUMP_VX> int opBNNN(const DECODED_INSTRUCTION &instr);
+    int opCXNN(const DECODED_INSTRUCTION &instr);
+    template<bool EXTENDED> int opDXYN(const DECODED_INSTRUCTION &instr); //EXTENDED: hi-res, 16x16 sprites and planes
+    template<bool LONG_SKIP> int opEX9E(const DECODED_INSTRUCTION &instr);
+    template<bool LONG_SKIP> int opEXA1(const DECODED_INSTRUCTION &instr);
+    int opFX07(const DECODED_INSTRUCTION &instr);
+    int opFX0A(const DECODED_INSTRUCTION &instr);
+    int opFX15(const DECODED_INSTRUCTION &instr);
+    int opFX18(const DECODED_INSTRUCTION &instr);
+    int opFX1E(const DECODED_INSTRUCTION &instr);
+    int opFX29(const DECODED_INSTRUCTION &instr);
+    int opFX33(const DECODED_INSTRUCTION &instr);
+    template<unsigned int INDEX_QUIRK> int opFX55(const DECODED_INSTRUCTION &instr);
+    template<unsigned int INDEX_QUIRK> int opFX65(const DECODED_INSTRUCTION &instr);
+    int opInvalid(const DECODED_INSTRUCTION &instr);
+    int op00CN(const DECODED_INSTRUCTION &instr);       //SUPER-CHIP
+    int op00FB(const DECODED_INSTRUCTION &instr);
+    int op00FC(const DECODED_INSTRUCTION &instr);
+    int op00FD(const DECODED_INSTRUCTION &instr);
+    int op00FE(const DECODED_INSTRUCTION &instr);
+    int op00FF(const DECODED_INSTRUCTION &instr);
+    int opFX30(const DECODED_INSTRUCTION &instr);
+    int opFX75(const DECODED_INSTRUCTION &instr);
+    int opFX85(const DECODED_INSTRUCTION &instr);
+    int op00DN(const DECODED_INSTRUCTION &instr);       //XO-CHIP
+    int op5XY2(const DECODED_INSTRUCTION &instr);
+    int op5XY3(const DECODED_INSTRUCTION &instr);
+    int opF000(const DECODED_INSTRUCTION &instr);
+    int opFN01(const DECODED_INSTRUCTION &instr);
+    int opF002(const DECODED_INSTRUCTION &instr);
+    int opFX3A(const DECODED_INSTRUCTION &instr);
+    bool isLongInstruction();                           //the instruction at the PC is XO-CHIP's four byte F000 NNNN
+    void scrollDisplay(int rows);                       //positive scrolls the selected planes down, negative up
+    void setResolution(bool hiRes);                     //00FE/00FF, the display is cleared
+    void markRowsChanged(uint64_t rows);                //for the host (dirtyRows) and for restoreBaseline()
+    void invalidateDecodeRange(unsigned int physicalAddr, unsigned int length); //bytes changed behind writeMemory()'s back
+    int op1NNNIdle(const DECODED_INSTRUCTION &instr);  //1NNN closing a loop that may be idle, asks the run loop to probe it
+    bool isIdleLoopCandidate(ushort jumpAddress, ushort target);   //short backward loop made only of instructions that can leave the state unchanged
+    unsigned long probeIdleLoop(unsigned long executed, unsigned long budget);  //instructions that can be skipped at the loop head (0 = none)
+    void translateBlock(ushort startAddress);           //builds the block starting at startAddress into blockCache
+    DECODED_INSTRUCTION* decodeAtPC() __attribute__((noinline));  //decode cache miss, kept out of line so emulatorTick() stays small enough to inline
+    unsigned char nextRandomByte();                     //steps this machine's pseudo-RNG
+
+    unsigned int programCounter;                        //physical address of the next instruction (full width, 16-bit stores stall the dispatch loop)
+    ushort indexRegister;
+    unsigned char v[CPU_GPR_COUNT];                     //General purpose registers
+    CHIP8_MEMORY memory;                                //this holds the entirety of the emulator's memory, paged so forks can share it
+    ushort addressMask;                                 //memory size - 1, every address wraps with it
+    //bit-packed display [plane][half][row]: the left 64 pixels of each row in half 0, the right 64 in half 1.  Lo-res
+    //only uses half 0 and the first GFX_HEIGHT rows, so the CHIP-8 display is one word per row as it always was
+    uint64_t frameBuffer[GFX_PLANE_COUNT][2][HIRES_GFX_HEIGHT];
+    bool hiRes;
+    unsigned char planeMask;                            //planes drawn, cleared and scrolled (FN01), bit p = plane p
+    uint64_t dirtyRows;                                 //rows drawn to since takeDirtyRows(), host side only (not machine state)
+    uint64_t baselineRows;                              //rows drawn to since saveBaseline()
+    unsigned char delayTimer;                           //counts down @60hz
+    unsigned char soundTimer;                           //counts down @60hz
+    ushort keyState;                                    //bit k set while key k is down, read by EX9E/EXA1/FX0A
+    ushort stack[STACK_DEPTH];                          //logical return addresses, kept out of guest memory so a runaway ROM cannot reach them
+    ushort sp;                                          //entries in use, stack[sp - 1] is the top
+    bool isRomLoaded;                                   //whether a ROM is currently loaded into emulator RAM
+    ushort sizeOfROM;
+    DECODED_INSTRUCTION *decodeCache;                   //decoded instruction for each address in memory, a shared table of empty entries until the first decode
+    unsigned int rngState;                              //xorshift state so every machine draws its own random sequence
+    unsigned int quirks;                                //QUIRK_* mask, only read when decoding
+    unsigned int platform;                              //PLATFORM_*, only read when decoding (and sizing memory)
+    unsigned char rplFlags[RPL_FLAG_COUNT];
+    unsigned char audioPattern[AUDIO_PATTERN_SIZE];
+    unsigned char audioPitch;                           //FX3A, playback rate is 4000 * 2^((pitch - 64) / 48) Hz
+
+    BLOCK_CACHE *blockCache;                            //translated blocks (NULL until runBlocks() is used)
+    IDLE_PROBE idleProbe;
+    unsigned long long stateWrites;                     //bumped by every memory or framebuffer write, an idle loop makes none
+    bool idleSkipEnabled;
+    unsigned long long idleSkipCount;
+    unsigned long long elidedInstructions;
+    ushort invalidOpcode;                               //set by opInvalid(), which prints nothing itself
+    CHIP8_EMULATOR *differentialReference;              //interpreter-only twin used by the differential check (NULL when off)
+    CHIP8_PROFILER *profiler;                           //not owned, NULL unless profiling
+    CHIP8_EMULATOR *baseline;                           //machine as saveBaseline() left it (NULL until then), shares its memory pages
+    unsigned char *edgeCoverage;                        //not owned, NULL unless fuzzing
+    uint64_t zobristStaleRows;                          //rows drawn to since getZobristHash() last hashed them
+    unsigned long long rowZobrist[HIRES_GFX_HEIGHT];    //each row's share of displayZobrist
+    unsigned long long displayZobrist;                  //XOR of rowZobrist
+};
+
+
+
+/*
+System Memory Map:
+0x000-0x1FF - Chip 8 interpreter (contains font set in emu)
+0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
+0x0A0-0x140 - SUPER-CHIP 8x10 pixel font set (0-F)
+0x200-0xFFF - Program ROM and work RAM (0x200-0xFFFF on XO-CHIP)
 */
\ No newline at end of file
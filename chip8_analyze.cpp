@@ -0,0 +1,194 @@
+/* Chip 8 Emulator  <chip8_analyze.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8_analyzer.h"
+#include "chip8_quirks.h"
+#include "chip8_rom_cache.h"
+
+using namespace std;
+
+static const char *exitNames[] = { "", "return", "exit", "indirect", "invalid" };
+static const char *edgeNames[] = { "fallthrough", "jump", "call", "skip" };
+
+struct ANALYSIS_JOB
+{
+    string romPath;
+    int status;
+    string report;
+};
+
+static void printUsage(const char *programName)
+{
+    cerr << "Usage: " << programName << " [options] rom.ch8|archive ..." << endl
+         << "  --platform=P      decode as chip8 (default), schip or xochip" << endl
+         << "  --threads=N       analyze on N threads (default: one per hardware thread)" << endl
+         << "  --cfg             print every block with its successors and every self-modifying store" << endl;
+}
+
+static string formatReport(const string &romPath, CHIP8_ROM_ANALYSIS &analysis, bool printCFG)
+{
+    const unsigned int code = analysis.countROMBytes(ROM_BYTE_CODE);
+    const unsigned int data = analysis.countROMBytes(ROM_BYTE_DATA_READ | ROM_BYTE_DATA_WRITE);
+    const unsigned int known = analysis.countROMBytes(ROM_BYTE_CODE | ROM_BYTE_DATA_READ | ROM_BYTE_DATA_WRITE);
+    ostringstream out;
+    out << romPath << " size=" << analysis.romSize << " code=" << code << " data=" << data
+        << " unknown=" << analysis.romSize - known << " instructions=" << analysis.instructions.size()
+        << " blocks=" << analysis.blocks.size() << " subroutines=" << analysis.subroutines.size()
+        << " indirect=" << analysis.indirectJumps << " smc=" << analysis.selfModifyingWrites.size()
+        << " unresolved_writes=" << analysis.unresolvedWrites << " invalid=" << analysis.invalidOpcodes
+        << " complete=" << (analysis.isComplete() ? "yes" : "no") << endl;
+    if(printCFG)
+    {
+        for(unsigned int b = 0; b < analysis.blocks.size(); b++)
+        {
+            const CFG_BLOCK &block = analysis.blocks[b];
+            out << "  block 0x" << hex << block.start << "-0x" << block.end << dec << ' ' << block.instructionCount;
+            if(block.exit != CFG_EXIT_NONE)
+            {
+                out << ' ' << exitNames[block.exit];
+            }
+            for(unsigned int e = 0; e < block.successors.size(); e++)
+            {
+                out << ' ' << edgeNames[block.successors[e].kind] << ":0x" << hex << block.successors[e].target << dec;
+            }
+            out << endl;
+        }
+        for(unsigned int w = 0; w < analysis.selfModifyingWrites.size(); w++)
+        {
+            const SMC_WRITE &write = analysis.selfModifyingWrites[w];
+            out << "  smc 0x" << hex << write.address << " writes 0x" << write.target << dec << '+' << write.length << endl;
+        }
+    }
+    return out.str();
+}
+
+static void analyzeJobs(vector<ANALYSIS_JOB> *jobs, atomic<unsigned int> *nextJob, unsigned int platform, bool printCFG)
+{
+    //one analyzer per thread, it keeps its buffers from ROM to ROM
+    CHIP8_ANALYZER analyzer;
+    CHIP8_ROM_ANALYSIS analysis;
+    for(unsigned int j = (*nextJob)++; j < jobs->size(); j = (*nextJob)++)
+    {
+        ANALYSIS_JOB &job = (*jobs)[j];
+        job.status = analyzer.analyze(job.romPath.c_str(), platform, analysis);
+        if(job.status == STATUS_SUCCESS)
+        {
+            job.report = formatReport(job.romPath, analysis, printCFG);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int platform = PLATFORM_CHIP8;
+    unsigned int threadCount = 0;
+    bool printCFG = false;
+    vector<ANALYSIS_JOB> jobs;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--platform=", 11) == 0)
+        {
+            if(parsePlatform(argv[i] + 11, &platform) != STATUS_SUCCESS)
+            {
+                printUsage(argv[0]);
+                return ERR_INVALID_ARGUMENT;
+            }
+        }
+        else if(strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            threadCount = strtoul(argv[i] + 10, NULL, 0);
+        }
+        else if(strcmp(argv[i], "--cfg") == 0)
+        {
+            printCFG = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            printUsage(argv[0]);
+            return ERR_INVALID_ARGUMENT;
+        }
+        else
+        {
+            vector<string> members;
+            if(CHIP8_ROM_CACHE::getInstance().listArchive(argv[i], members) != STATUS_SUCCESS)
+            {   //a plain ROM (or archive:member)
+                members.push_back(argv[i]);
+            }
+            for(unsigned int m = 0; m < members.size(); m++)
+            {
+                jobs.push_back(ANALYSIS_JOB { members[m], STATUS_SUCCESS, "" });
+            }
+        }
+    }
+    if(jobs.empty())
+    {
+        printUsage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+    }
+
+    if(threadCount == 0)
+    {
+        threadCount = thread::hardware_concurrency();
+        if(threadCount == 0)
+        {   //not computable on this platform
+            threadCount = 1;
+        }
+    }
+    if(threadCount > jobs.size())
+    {
+        threadCount = jobs.size();
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    atomic<unsigned int> nextJob(0);
+    vector<thread> workers;
+    for(unsigned int t = 0; t < threadCount; t++)
+    {
+        workers.push_back(thread(analyzeJobs, &jobs, &nextJob, platform, printCFG));
+    }
+    for(unsigned int t = 0; t < threadCount; t++)
+    {
+        workers[t].join();
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int returnValue = STATUS_SUCCESS;
+    for(unsigned int j = 0; j < jobs.size(); j++)
+    {   //in the order given, whichever thread finished first
+        if(jobs[j].status == STATUS_SUCCESS)
+        {
+            cout << jobs[j].report;
+        }
+        else
+        {
+            cout << jobs[j].romPath << " error=" << jobs[j].status << endl;
+            returnValue = jobs[j].status;
+        }
+    }
+    cout << "# " << jobs.size() << " ROMs on " << threadCount << " threads in " << elapsed << " s ("
+         << (elapsed > 0.0 ? jobs.size() / elapsed : 0.0) << " per second)" << endl;
+    return returnValue;
+}
@@ -0,0 +1,388 @@
+/* Chip 8 Emulator  <chip8_analyzer.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <memory>
+#include "chip8_analyzer.h"
+#include "chip8_rom_cache.h"
+
+using namespace std;
+
+unsigned int CHIP8_ROM_ANALYSIS::countROMBytes(unsigned char flags)
+{
+    unsigned int count = 0;
+    for(unsigned int address = BASE_RAM_OFFSET; address < BASE_RAM_OFFSET + romSize && address < byteFlags.size(); address++)
+    {
+        count += (byteFlags[address] & flags) != 0;
+    }
+    return count;
+}
+
+bool CHIP8_ROM_ANALYSIS::isComplete()
+{
+    return indirectJumps == 0 && unresolvedWrites == 0;
+}
+
+bool CHIP8_ROM_ANALYSIS::pageHasCode(unsigned int page)
+{
+    for(unsigned int address = page * MEMORY_PAGE_SIZE; address < (page + 1) * MEMORY_PAGE_SIZE && address < byteFlags.size(); address++)
+    {
+        if(byteFlags[address] & ROM_BYTE_CODE)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+CHIP8_ANALYZER::CHIP8_ANALYZER()
+{
+    decoder = new CHIP8_EMULATOR();     //heap allocated like every other machine, it is large
+    addressMask = MEMORY_SIZE - 1;
+    xo = false;
+}
+
+CHIP8_ANALYZER::~CHIP8_ANALYZER()
+{
+    delete decoder;
+}
+
+int CHIP8_ANALYZER::analyze(const char *romPath, unsigned int platform, CHIP8_ROM_ANALYSIS &analysis)
+{
+    shared_ptr<const CHIP8_ROM_IMAGE> image;
+    int returnValue = CHIP8_ROM_CACHE::getInstance().getROM(romPath, image);
+    if(returnValue == STATUS_SUCCESS)
+    {
+        returnValue = analyze(*image, platform, analysis);
+    }
+    return returnValue;
+}
+
+int CHIP8_ANALYZER::analyze(const CHIP8_ROM_IMAGE &image, unsigned int platform, CHIP8_ROM_ANALYSIS &analysis)
+{
+    if(decoder->setPlatform(platform) != STATUS_SUCCESS)
+    {
+        return ERR_INVALID_ARGUMENT;
+    }
+    const unsigned int memorySize = decoder->getMemorySize();
+    if(image.memory.getSize() > memorySize)
+    {
+        return ERR_ROM_GREATER_THAN_RAM;
+    }
+    memory = image.memory;      //shares the image's pages, nothing is copied
+    memory.resize(memorySize);
+    addressMask = memorySize - 1;
+    xo = platform == PLATFORM_XOCHIP;
+    instructionStart.assign(memorySize, 0);
+    leader.assign(memorySize, 0);
+
+    analysis.platform = platform;
+    analysis.romSize = image.size;
+    analysis.byteFlags.assign(memorySize, 0);
+    analysis.instructions.clear();
+    analysis.blocks.clear();
+    analysis.subroutines.clear();
+    analysis.selfModifyingWrites.clear();
+    analysis.indirectJumps = 0;
+    analysis.unresolvedWrites = 0;
+    analysis.invalidOpcodes = 0;
+
+    explore(analysis);
+    buildBlocks(analysis);
+    for(unsigned int b = 0; b < analysis.blocks.size(); b++)
+    {   //code is complete now, so every store can be checked against it
+        trackData(analysis, analysis.blocks[b]);
+    }
+    return STATUS_SUCCESS;
+}
+
+ushort CHIP8_ANALYZER::readOpcode(ushort address)
+{
+    return (memory.read(address & addressMask) << 8) | memory.read((address + 1) & addressMask);
+}
+
+bool CHIP8_ANALYZER::isSkip(ushort opcode)
+{
+    switch(opcode & 0xF000)
+    {
+        case 0x3000:
+        case 0x4000:
+        case 0x9000:
+        case 0xE000:    //EX9E/EXA1, the only valid E opcodes
+            return true;
+        case 0x5000:    //every 5XYN is 5XY0, except XO-CHIP's register range store and load 5XY2/5XY3
+            return !xo || ((opcode & 0x000F) != 2 && (opcode & 0x000F) != 3);
+    }
+    return false;
+}
+
+unsigned int CHIP8_ANALYZER::instructionLength(ushort address)
+{
+    return (xo && readOpcode(address) == 0xF000) ? 4 : 2;
+}
+
+void CHIP8_ANALYZER::explore(CHIP8_ROM_ANALYSIS &analysis)
+{
+    vector<ushort> pending;
+    pending.push_back(BASE_RAM_OFFSET);
+    leader[BASE_RAM_OFFSET] = 1;
+    while(!pending.empty())
+    {
+        ushort address = pending.back();
+        pending.pop_back();
+        bool following = true;
+        while(following && !instructionStart[address])
+        {   //one straight line of code, every other way out is queued
+            ushort opcode = readOpcode(address);
+            if(!decoder->isValidOpcode(opcode))
+            {
+                analysis.invalidOpcodes++;
+                break;
+            }
+            const unsigned int length = instructionLength(address);
+            instructionStart[address] = 1;
+            analysis.instructions.push_back(address);
+            for(unsigned int b = 0; b < length; b++)
+            {
+                analysis.byteFlags[(address + b) & addressMask] |= ROM_BYTE_CODE;
+            }
+            const ushort next = (address + length) & addressMask;
+            const ushort target = (BASE_RAM_OFFSET + (opcode & 0x0FFF)) & addressMask;
+
+            switch(opcode & 0xF000)
+            {
+                case 0x0000:
+                    following = (opcode != 0x00EE) && (opcode != 0x00FD);
+                    break;
+
+                case 0x1000:
+                    leader[target] = 1;
+                    pending.push_back(target);
+                    following = false;
+                    break;
+
+                case 0x2000:
+                    leader[target] = 1;
+                    leader[next] = 1;   //where the subroutine returns to
+                    pending.push_back(target);
+                    analysis.subroutines.push_back(target);
+                    break;
+
+                case 0xB000:
+                    analysis.indirectJumps++;
+                    following = false;
+                    break;
+
+                default:
+                    if(isSkip(opcode))
+                    {
+                        ushort skipTarget = (next + instructionLength(next)) & addressMask;
+                        leader[next] = 1;
+                        leader[skipTarget] = 1;
+                        pending.push_back(skipTarget);
+                    }
+                    break;
+            }
+            address = next;
+        }
+    }
+    sort(analysis.instructions.begin(), analysis.instructions.end());
+    sort(analysis.subroutines.begin(), analysis.subroutines.end());
+    analysis.subroutines.erase(unique(analysis.subroutines.begin(), analysis.subroutines.end()), analysis.subroutines.end());
+}
+
+void CHIP8_ANALYZER::buildBlocks(CHIP8_ROM_ANALYSIS &analysis)
+{
+    for(unsigned int i = 0; i < analysis.instructions.size(); i++)
+    {
+        ushort address = analysis.instructions[i];
+        if(!leader[address])
+        {   //inside the block of an earlier leader
+            continue;
+        }
+        CFG_BLOCK block;
+        block.start = address;
+        block.instructionCount = 0;
+        block.exit = CFG_EXIT_NONE;
+        while(true)
+        {
+            const ushort opcode = readOpcode(address);
+            const ushort next = (address + instructionLength(address)) & addressMask;
+            const ushort target = (BASE_RAM_OFFSET + (opcode & 0x0FFF)) & addressMask;
+            block.instructionCount++;
+            address = next;
+
+            bool ends = true;
+            switch(opcode & 0xF000)
+            {
+                case 0x0000:
+                    if(opcode == 0x00EE || opcode == 0x00FD)
+                    {
+                        block.exit = (opcode == 0x00EE) ? CFG_EXIT_RETURN : CFG_EXIT_PROGRAM;
+                    }
+                    else
+                    {
+                        ends = false;
+                    }
+                    break;
+
+                case 0x1000:
+                    block.successors.push_back(CFG_EDGE { target, CFG_EDGE_JUMP });
+                    break;
+
+                case 0x2000:
+                    block.successors.push_back(CFG_EDGE { target, CFG_EDGE_CALL });
+                    block.successors.push_back(CFG_EDGE { next, CFG_EDGE_FALLTHROUGH });
+                    break;
+
+                case 0xB000:
+                    block.exit = CFG_EXIT_INDIRECT;
+                    break;
+
+                default:
+                    ends = isSkip(opcode);
+                    if(ends)
+                    {
+                        block.successors.push_back(CFG_EDGE { next, CFG_EDGE_FALLTHROUGH });
+                        block.successors.push_back(CFG_EDGE { (ushort) ((next + instructionLength(next)) & addressMask), CFG_EDGE_SKIP });
+                    }
+                    break;
+            }
+            if(ends)
+            {
+                break;
+            }
+            if(!instructionStart[address])
+            {   //ran into something that does not decode
+                block.exit = CFG_EXIT_INVALID;
+                break;
+            }
+            if(leader[address])
+            {
+                block.successors.push_back(CFG_EDGE { address, CFG_EDGE_FALLTHROUGH });
+                break;
+            }
+        }
+        block.end = address;
+        analysis.blocks.push_back(block);
+    }
+}
+
+void CHIP8_ANALYZER::trackData(CHIP8_ROM_ANALYSIS &analysis, const CFG_BLOCK &block)
+{
+    //I is only known from an ANNN or F000 NNNN earlier in the same block, the block's entry may come from anywhere
+    bool known = false;
+    ushort index = 0;       //physical address I points at
+    ushort address = block.start;
+    for(unsigned int i = 0; i < block.instructionCount; i++)
+    {
+        const ushort opcode = readOpcode(address);
+        const unsigned int x = (opcode >> 8) & 0x0F;
+        const unsigned int y = (opcode >> 4) & 0x0F;
+        switch(opcode & 0xF000)
+        {
+            case 0xA000:
+                index = (BASE_RAM_OFFSET + (opcode & 0x0FFF)) & addressMask;
+                known = true;
+                break;
+
+            case 0xD000:
+            {
+                unsigned int rows = opcode & 0x000F;
+                if(rows == 0 && analysis.platform != PLATFORM_CHIP8)
+                {   //16x16 sprite, two bytes a row
+                    rows = 32;
+                }
+                if(known)
+                {
+                    markAccess(analysis, address, index, rows, ROM_BYTE_DATA_READ);
+                }
+                break;
+            }
+
+            case 0x5000:
+                if(!isSkip(opcode))
+                {   //XO-CHIP 5XY2/5XY3 store and load a register range
+                    const bool store = (opcode & 0x000F) == 2;
+                    if(known)
+                    {
+                        markAccess(analysis, address, index, (x > y ? x - y : y - x) + 1, store ? ROM_BYTE_DATA_WRITE : ROM_BYTE_DATA_READ);
+                    }
+                    else if(store)
+                    {
+                        analysis.unresolvedWrites++;
+                    }
+                }
+                break;
+
+            case 0xF000:
+                if(opcode == 0xF000)
+                {
+                    index = (BASE_RAM_OFFSET + readOpcode(address + 2)) & addressMask;
+                    known = true;
+                }
+                else if((opcode & 0x00FF) == 0x33 || (opcode & 0x00FF) == 0x55)
+                {
+                    if(known)
+                    {
+                        markAccess(analysis, address, index, (opcode & 0x00FF) == 0x33 ? 3 : x + 1, ROM_BYTE_DATA_WRITE);
+                    }
+                    else
+                    {
+                        analysis.unresolvedWrites++;
+                    }
+                    known = known && (opcode & 0x00FF) == 0x33;     //FX55 may move I, depending on the quirks
+                }
+                else if((opcode & 0x00FF) == 0x65)
+                {
+                    if(known)
+                    {
+                        markAccess(analysis, address, index, x + 1, ROM_BYTE_DATA_READ);
+                    }
+                    known = false;
+                }
+                else if(opcode == 0xF002)
+                {
+                    if(known)
+                    {
+                        markAccess(analysis, address, index, AUDIO_PATTERN_SIZE, ROM_BYTE_DATA_READ);
+                    }
+                }
+                else if((opcode & 0x00FF) == 0x1E || (opcode & 0x00FF) == 0x29 || (opcode & 0x00FF) == 0x30)
+                {   //I now depends on a register
+                    known = false;
+                }
+                break;
+        }
+        address = (address + instructionLength(address)) & addressMask;
+    }
+}
+
+void CHIP8_ANALYZER::markAccess(CHIP8_ROM_ANALYSIS &analysis, ushort instruction, ushort start, unsigned int length, unsigned char flag)
+{
+    bool touchesCode = false;
+    for(unsigned int b = 0; b < length; b++)
+    {
+        unsigned char &flags = analysis.byteFlags[(start + b) & addressMask];
+        flags |= flag;
+        touchesCode = touchesCode || (flags & ROM_BYTE_CODE) != 0;
+    }
+    if(touchesCode && flag == ROM_BYTE_DATA_WRITE)
+    {
+        analysis.selfModifyingWrites.push_back(SMC_WRITE { instruction, start, (ushort) length });
+    }
+}
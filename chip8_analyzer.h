@@ -0,0 +1,107 @@
+/* Chip 8 Emulator  <chip8_analyzer.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <vector>
+#include "chip8.h"
+
+#define ROM_BYTE_CODE           0x01        //part of a reachable instruction
+#define ROM_BYTE_DATA_READ      0x02        //read through a known I by a reachable DXYN, FX65, 5XY3 or F002 (sprites, tables)
+#define ROM_BYTE_DATA_WRITE     0x04        //written through a known I by a reachable FX55, FX33 or 5XY2
+
+#define CFG_EDGE_FALLTHROUGH    0           //runs on into the next block
+#define CFG_EDGE_JUMP           1           //1NNN
+#define CFG_EDGE_CALL           2           //2NNN, the block also has a fallthrough edge to the return address
+#define CFG_EDGE_SKIP           3           //the target of a taken skip, the fallthrough edge is the untaken one
+
+#define CFG_EXIT_NONE           0           //ends in an edge
+#define CFG_EXIT_RETURN         1           //00EE
+#define CFG_EXIT_PROGRAM        2           //00FD
+#define CFG_EXIT_INDIRECT       3           //BNNN, the target depends on a register and is not followed
+#define CFG_EXIT_INVALID        4           //runs into an address that does not hold a valid instruction
+
+struct CFG_EDGE
+{
+    ushort target;                          //physical address of the successor block
+    unsigned char kind;                     //CFG_EDGE_*
+};
+
+struct CFG_BLOCK                            //straight line code: only its last instruction can go anywhere but the next one
+{
+    ushort start;                           //physical address of the first instruction
+    ushort end;                             //physical address just past the last instruction
+    unsigned int instructionCount;
+    unsigned char exit;                     //CFG_EXIT_*
+    std::vector<CFG_EDGE> successors;
+};
+
+struct SMC_WRITE                            //a reachable store that lands on reachable code
+{
+    ushort address;                         //the storing instruction
+    ushort target;                          //first byte written
+    ushort length;
+};
+
+/*
+ * What a ROM does before it runs.  Exploration starts at BASE_RAM_OFFSET and follows fallthrough, 1NNN, 2NNN (into
+ * the subroutine and on to the return address) and both ways out of every skip.  I is tracked within a block from
+ * ANNN and F000 NNNN, so the sprite rows a DXYN draws and the range an FX55 stores to are known when they use it.
+ * Addresses are physical and wrap at the platform's memory size, like the emulator's.
+ */
+struct CHIP8_ROM_ANALYSIS
+{
+    unsigned int platform;
+    unsigned int romSize;                   //bytes from BASE_RAM_OFFSET
+    std::vector<unsigned char> byteFlags;   //ROM_BYTE_* for every address of the platform's memory
+    std::vector<ushort> instructions;       //every reachable instruction, sorted
+    std::vector<CFG_BLOCK> blocks;          //sorted by start, one per leader (entry, jump/call/skip target, return address)
+    std::vector<ushort> subroutines;        //2NNN targets, sorted
+    std::vector<SMC_WRITE> selfModifyingWrites;
+    unsigned int indirectJumps;             //reachable BNNN
+    unsigned int unresolvedWrites;          //reachable stores through an I that is not known, they may land anywhere
+    unsigned int invalidOpcodes;            //reachable addresses holding no valid instruction
+
+    unsigned int countROMBytes(unsigned char flags);   //ROM bytes with any of these flags
+    bool isComplete();                      //no indirect jump and no store left unresolved: nothing outside the CFG can run or change
+    bool pageHasCode(unsigned int page);    //MEMORY_PAGE_SIZE pages, a complete analysis with no code on a page means writes there never touch code
+};
+
+class CHIP8_ANALYZER
+{
+    public:
+    CHIP8_ANALYZER();
+    ~CHIP8_ANALYZER();
+
+    int analyze(const char *romPath, unsigned int platform, CHIP8_ROM_ANALYSIS &analysis);   //file or archive:member, through the ROM cache
+    int analyze(const CHIP8_ROM_IMAGE &image, unsigned int platform, CHIP8_ROM_ANALYSIS &analysis);
+
+    private:
+    ushort readOpcode(ushort address);
+    bool isSkip(ushort opcode);
+    unsigned int instructionLength(ushort address);     //4 for XO-CHIP's F000 NNNN, otherwise 2
+    void explore(CHIP8_ROM_ANALYSIS &analysis);
+    void buildBlocks(CHIP8_ROM_ANALYSIS &analysis);
+    void trackData(CHIP8_ROM_ANALYSIS &analysis, const CFG_BLOCK &block);
+    void markAccess(CHIP8_ROM_ANALYSIS &analysis, ushort instruction, ushort start, unsigned int length, unsigned char flag);
+
+    CHIP8_EMULATOR *decoder;                //only decodes, so validity is whatever the emulator itself accepts
+    CHIP8_MEMORY memory;
+    ushort addressMask;
+    bool xo;
+    std::vector<unsigned char> instructionStart;    //non-zero where a reachable instruction starts
+    std::vector<unsigned char> leader;              //non-zero where a block must start
+};
@@ -0,0 +1,328 @@
+/* Chip 8 Emulator  <chip8_audio.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "chip8_audio.h"
+
+using namespace std;
+
+static const unsigned char beepPattern[AUDIO_PATTERN_SIZE] =    //square wave, 8 periods of 16 pattern bits
+{
+    0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00
+};
+
+CHIP8_AUDIO_RING::CHIP8_AUDIO_RING()
+{
+    memset(samples, 0, sizeof(samples));
+    head.store(0);
+    tail.store(0);
+    overrunSamples = 0;
+    underrunSamples = 0;
+    waitForSpace = false;
+}
+
+void CHIP8_AUDIO_RING::setWaitForSpace(bool enabled)
+{
+    waitForSpace = enabled;
+}
+
+unsigned int CHIP8_AUDIO_RING::write(const short *samples, unsigned int count)
+{
+    unsigned int written = head.load(memory_order_relaxed);
+    unsigned int space = AUDIO_RING_SAMPLES - (written - tail.load(memory_order_acquire));
+    while(waitForSpace && count > space)
+    {   //flat-out capture: hand the CPU to the consumer until it has taken enough
+        this_thread::yield();
+        space = AUDIO_RING_SAMPLES - (written - tail.load(memory_order_acquire));
+    }
+    if(count > space)
+    {
+        overrunSamples += count - space;
+        count = space;
+    }
+    //indices run freely and wrap at 2^32, a power of two capacity keeps the masked positions consistent
+    unsigned int start = written & (AUDIO_RING_SAMPLES - 1);
+    unsigned int first = (count < AUDIO_RING_SAMPLES - start) ? count : AUDIO_RING_SAMPLES - start;
+    memcpy(&this->samples[start], samples, first * sizeof(short));
+    memcpy(this->samples, samples + first, (count - first) * sizeof(short));
+    head.store(written + count, memory_order_release);
+    return count;
+}
+
+unsigned int CHIP8_AUDIO_RING::read(short *samples, unsigned int count)
+{
+    unsigned int taken = tail.load(memory_order_relaxed);
+    unsigned int waiting = head.load(memory_order_acquire) - taken;
+    if(count > waiting)
+    {
+        count = waiting;
+    }
+    unsigned int start = taken & (AUDIO_RING_SAMPLES - 1);
+    unsigned int first = (count < AUDIO_RING_SAMPLES - start) ? count : AUDIO_RING_SAMPLES - start;
+    memcpy(samples, &this->samples[start], first * sizeof(short));
+    memcpy(samples + first, this->samples, (count - first) * sizeof(short));
+    tail.store(taken + count, memory_order_release);
+    return count;
+}
+
+void CHIP8_AUDIO_RING::pull(short *samples, unsigned int count)
+{
+    unsigned int got = read(samples, count);
+    if(got < count)
+    {
+        memset(samples + got, 0, (count - got) * sizeof(short));
+        underrunSamples += count - got;
+    }
+}
+
+unsigned long long CHIP8_AUDIO_RING::getOverrunSamples()
+{
+    return overrunSamples;
+}
+
+unsigned long long CHIP8_AUDIO_RING::getUnderrunSamples()
+{
+    return underrunSamples;
+}
+
+CHIP8_AUDIO_SYNTH::CHIP8_AUDIO_SYNTH(CHIP8_AUDIO_RING &ring, unsigned int sampleRate) : ring(ring)
+{
+    this -> sampleRate = (sampleRate > 0) ? sampleRate : AUDIO_SAMPLE_RATE;
+    block.assign(this->sampleRate / TIMER_FREQUENCY + 1, 0);
+    frames = 0;
+    samples = 0;
+    audibleFrames = 0;
+    phase = 0;
+    blockSilent = true;
+}
+
+void CHIP8_AUDIO_SYNTH::renderFrame(CHIP8_EMULATOR &emulator)
+{
+    //cumulative, like the scheduler's frames: rates that are not a multiple of 60 never drift
+    unsigned int count = (unsigned int) ((frames + 1) * sampleRate / TIMER_FREQUENCY - frames * sampleRate / TIMER_FREQUENCY);
+    frames++;
+    samples += count;
+
+    if(emulator.getSoundTimer() == 0)
+    {   //silent frames still take their place in the stream, the block stays zeroed until the next tone
+        if(!blockSilent)
+        {
+            memset(block.data(), 0, block.size() * sizeof(short));
+            blockSilent = true;
+        }
+        phase = 0;
+        ring.write(block.data(), count);
+        return;
+    }
+
+    const unsigned char *pattern = beepPattern;
+    double bitRate = AUDIO_BEEP_FREQUENCY * 16.0;
+    if(emulator.getPlatform() == PLATFORM_XOCHIP)
+    {
+        pattern = emulator.getAudioPattern();
+        bitRate = AUDIO_PATTERN_RATE * pow(2.0, (emulator.getAudioPitch() - 64) / 48.0);
+    }
+    unsigned int step = (unsigned int) (bitRate * (1 << AUDIO_PHASE_BITS) / sampleRate);
+    for(unsigned int i = 0; i < count; i++, phase += step)
+    {
+        unsigned int bit = (phase >> AUDIO_PHASE_BITS) & (AUDIO_PATTERN_BITS - 1);
+        block[i] = ((pattern[bit >> 3] >> (7 - (bit & 7))) & 1) ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+    }
+    phase &= (AUDIO_PATTERN_BITS << AUDIO_PHASE_BITS) - 1;
+    blockSilent = false;
+    audibleFrames++;
+    ring.write(block.data(), count);
+}
+
+unsigned int CHIP8_AUDIO_SYNTH::getSampleRate()
+{
+    return sampleRate;
+}
+
+unsigned long long CHIP8_AUDIO_SYNTH::getFrameCount()
+{
+    return frames;
+}
+
+unsigned long long CHIP8_AUDIO_SYNTH::getSampleCount()
+{
+    return samples;
+}
+
+unsigned long long CHIP8_AUDIO_SYNTH::getAudibleFrames()
+{
+    return audibleFrames;
+}
+
+CHIP8_WAV_SINK::CHIP8_WAV_SINK(CHIP8_AUDIO_RING &ring, unsigned int sampleRate) : ring(ring)
+{
+    this -> sampleRate = (sampleRate > 0) ? sampleRate : AUDIO_SAMPLE_RATE;
+    stopping.store(false);
+    realTime = false;
+    buffer.assign(AUDIO_RING_SAMPLES, 0);
+    encoded.assign(2 * AUDIO_RING_SAMPLES, 0);
+    samplesWritten = 0;
+    status = STATUS_SUCCESS;
+}
+
+CHIP8_WAV_SINK::~CHIP8_WAV_SINK()
+{
+    stop();
+}
+
+int CHIP8_WAV_SINK::open(const char *filename)
+{
+    outFile.open(filename, ios::binary | ios::trunc);
+    if(!outFile.is_open())
+    {
+        return ERR_UNABLE_OPEN_FILE;
+    }
+    writeHeader(0);     //sizes are filled in by stop()
+    return outFile.good() ? STATUS_SUCCESS : ERR_UNABLE_OPEN_FILE;
+}
+
+void CHIP8_WAV_SINK::start(bool realTime)
+{
+    if(!worker.joinable() && outFile.is_open())
+    {
+        this -> realTime = realTime;
+        ring.setWaitForSpace(!realTime);
+        stopping.store(false);
+        worker = thread(&CHIP8_WAV_SINK::sinkLoop, this);
+    }
+}
+
+void CHIP8_WAV_SINK::stop()
+{
+    if(!worker.joinable())
+    {
+        return;
+    }
+    stopping.store(true);
+    worker.join();
+    //the emulation thread is done, whatever it rendered last is still in the ring
+    unsigned int count;
+    while((count = ring.read(buffer.data(), buffer.size())) > 0)
+    {
+        writeSamples(buffer.data(), count);
+    }
+    outFile.seekp(0);
+    writeHeader(samplesWritten * sizeof(short));
+    outFile.close();
+    if(outFile.fail() && status == STATUS_SUCCESS)
+    {
+        cerr << "Unable to write audio file!" << endl;
+        status = ERR_UNABLE_OPEN_FILE;
+    }
+}
+
+unsigned long long CHIP8_WAV_SINK::getSamplesWritten()
+{
+    return samplesWritten;
+}
+
+int CHIP8_WAV_SINK::getStatus()
+{
+    return status;
+}
+
+void CHIP8_WAV_SINK::sinkLoop()
+{
+    chrono::steady_clock::time_point start;
+    unsigned long long pulled = 0;
+    bool playing = false;
+    unsigned int count = 0;
+    while(!stopping.load())
+    {
+        if(count == 0)
+        {   //only sleeps when the last pass found the ring empty, a waiting producer is let go at once
+            this_thread::sleep_for(chrono::microseconds(AUDIO_SINK_POLL_US));
+        }
+        if(!realTime || !playing)
+        {   //as fast as the file takes it, or in real time until the first frame arrives
+            count = ring.read(buffer.data(), buffer.size());
+            writeSamples(buffer.data(), count);
+            pulled += count;
+            if(realTime && pulled > 0)
+            {   //playback starts now, the frame already taken is the latency a sound card would buffer
+                start = chrono::steady_clock::now();
+                playing = true;
+            }
+            continue;
+        }
+        //exactly the samples the wall clock has played since the start, computed from it rather than accumulated
+        unsigned long long nanoseconds = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        unsigned long long due = nanoseconds / 1000000000ULL * sampleRate + nanoseconds % 1000000000ULL * sampleRate / 1000000000ULL;
+        while(pulled < due)
+        {
+            unsigned int chunk = (due - pulled < buffer.size()) ? (unsigned int) (due - pulled) : buffer.size();
+            ring.pull(buffer.data(), chunk);
+            writeSamples(buffer.data(), chunk);
+            pulled += chunk;
+        }
+        count = 0;      //paced, the next samples are not due before the next wakeup
+    }
+}
+
+void CHIP8_WAV_SINK::writeSamples(const short *samples, unsigned int count)
+{
+    if((samplesWritten + count) * sizeof(short) > AUDIO_WAV_MAX_DATA)
+    {   //the RIFF header cannot describe more, the rest of the run is consumed and not written
+        count = (unsigned int) (AUDIO_WAV_MAX_DATA / sizeof(short) - samplesWritten);
+    }
+    for(unsigned int i = 0; i < count; i++)
+    {   //WAV samples are little endian whatever the host is
+        encoded[2 * i] = (unsigned char) samples[i];
+        encoded[2 * i + 1] = (unsigned char) ((unsigned short) samples[i] >> 8);
+    }
+    outFile.write((const char *) encoded.data(), 2 * count);
+    if(!outFile.good() && status == STATUS_SUCCESS)
+    {
+        cerr << "Unable to write audio file!" << endl;
+        status = ERR_UNABLE_OPEN_FILE;
+    }
+    samplesWritten += count;
+}
+
+static void putLE(unsigned char *out, unsigned int value, unsigned int size)
+{
+    for(unsigned int i = 0; i < size; i++)
+    {
+        out[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+void CHIP8_WAV_SINK::writeHeader(unsigned long long dataBytes)
+{
+    unsigned char header[AUDIO_WAV_HEADER_SIZE];
+    memcpy(header, "RIFF", 4);
+    putLE(header + 4, (unsigned int) (dataBytes + AUDIO_WAV_HEADER_SIZE - 8), 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLE(header + 16, 16, 4);                          //fmt chunk size
+    putLE(header + 20, 1, 2);                           //PCM
+    putLE(header + 22, 1, 2);                           //mono
+    putLE(header + 24, sampleRate, 4);
+    putLE(header + 28, sampleRate * sizeof(short), 4);  //bytes per second
+    putLE(header + 32, sizeof(short), 2);               //bytes per sample frame
+    putLE(header + 34, 16, 2);                          //bits per sample
+    memcpy(header + 36, "data", 4);
+    putLE(header + 40, (unsigned int) dataBytes, 4);
+    outFile.write((const char *) header, sizeof(header));
+}
@@ -0,0 +1,125 @@
+/* Chip 8 Emulator  <chip8_audio.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+
+#define AUDIO_SAMPLE_RATE       48000       //16 bit mono samples per second of virtual time
+#define AUDIO_RING_SAMPLES      (1 << 16)   //ring capacity, a power of two (about 1.4 s at 48 kHz)
+#define AUDIO_AMPLITUDE         8192        //square wave level, a quarter of full scale
+#define AUDIO_BEEP_FREQUENCY    440         //Hz, the plain CHIP-8/SUPER-CHIP beeper
+#define AUDIO_PATTERN_BITS      (AUDIO_PATTERN_SIZE * 8)
+#define AUDIO_PATTERN_RATE      4000.0      //XO-CHIP pattern bits per second at pitch 64
+#define AUDIO_PHASE_BITS        16          //fractional bits of the synthesizer's pattern position
+#define AUDIO_SINK_POLL_US      5000        //how long the sink sleeps between draining the ring
+#define AUDIO_WAV_HEADER_SIZE   44
+#define AUDIO_WAV_MAX_DATA      (0xFFFFFFFFULL - AUDIO_WAV_HEADER_SIZE + 8)    //RIFF sizes are 32 bit, samples past this are not written
+
+/*
+ * Lock-free single producer, single consumer ring of samples.  The emulation thread writes and one audio thread
+ * reads.  Paced runs never wait: a write that does not fit drops the samples that do not (overrun), and a pull that
+ * finds too few pads the rest with silence (underrun).  A flat-out capture sets setWaitForSpace() instead, so the
+ * producer waits for the consumer rather than lose audio.  Each side only stores its own index and loads the other's.
+ */
+class CHIP8_AUDIO_RING
+{
+    public:
+    CHIP8_AUDIO_RING();
+
+    void setWaitForSpace(bool enabled);                 //write() waits for the consumer instead of dropping (off by default)
+    unsigned int write(const short *samples, unsigned int count);   //producer, returns how many fit, the rest count as overrun
+    unsigned int read(short *samples, unsigned int count);          //consumer, returns how many were waiting (at most count)
+    void pull(short *samples, unsigned int count);      //consumer at device pace: always count samples, silence where the ring ran dry
+    unsigned long long getOverrunSamples();             //samples dropped because the ring was full, producer thread only
+    unsigned long long getUnderrunSamples();            //silence pull() had to make up, consumer thread only
+
+    private:
+    short samples[AUDIO_RING_SAMPLES];
+    alignas(64) std::atomic<unsigned int> head;         //samples ever written, stored by the producer
+    unsigned long long overrunSamples;
+    bool waitForSpace;
+    alignas(64) std::atomic<unsigned int> tail;         //samples ever read, stored by the consumer
+    unsigned long long underrunSamples;
+};
+
+/*
+ * Turns the sound timer into samples, one frame's worth at each 60hz frame boundary rather than per instruction.
+ * While the timer is running it plays the XO-CHIP audio pattern at the FX3A pitch, or a AUDIO_BEEP_FREQUENCY square
+ * wave on the other platforms.  Frame k gets exactly (k + 1) * rate / 60 - k * rate / 60 samples, built in a buffer
+ * sized once in the constructor, so rendering never allocates and the same run always gives the same samples.
+ */
+class CHIP8_AUDIO_SYNTH
+{
+    public:
+    CHIP8_AUDIO_SYNTH(CHIP8_AUDIO_RING &ring, unsigned int sampleRate = AUDIO_SAMPLE_RATE);
+
+    void renderFrame(CHIP8_EMULATOR &emulator);         //emulation thread, call before the frame's timer tick
+    unsigned int getSampleRate();
+    unsigned long long getFrameCount();                 //frames rendered
+    unsigned long long getSampleCount();                //samples rendered, written to the ring or dropped
+    unsigned long long getAudibleFrames();              //frames the sound timer was running in
+
+    private:
+    CHIP8_AUDIO_RING &ring;
+    unsigned int sampleRate;
+    std::vector<short> block;                           //one frame of samples
+    bool blockSilent;                                   //block holds nothing but zeroes
+    unsigned long long frames;
+    unsigned long long samples;
+    unsigned long long audibleFrames;
+    unsigned int phase;                                 //pattern bit position << AUDIO_PHASE_BITS, restarts with every tone
+};
+
+/*
+ * Headless audio output: a thread that drains a CHIP8_AUDIO_RING into a 16 bit mono PCM WAV file.  In real time
+ * mode it takes samples at the sample rate of the wall clock, like a sound card would, so a producer that falls
+ * behind shows up as underruns and silence in the file.  Otherwise it writes whatever the ring holds as soon as
+ * it can, and start() makes the ring wait for space, so the file gets every sample however fast the emulator runs.
+ */
+class CHIP8_WAV_SINK
+{
+    public:
+    CHIP8_WAV_SINK(CHIP8_AUDIO_RING &ring, unsigned int sampleRate = AUDIO_SAMPLE_RATE);
+    ~CHIP8_WAV_SINK();
+
+    int open(const char *filename);                     //ERR_UNABLE_OPEN_FILE when the file cannot be created
+    void start(bool realTime);                          //not real time: the producer waits for the file instead of dropping samples
+    void stop();                                        //writes what is left in the ring, fixes up the header and closes the file
+    unsigned long long getSamplesWritten();             //after stop()
+    int getStatus();                                    //STATUS_SUCCESS or ERR_UNABLE_OPEN_FILE after a failed write
+
+    private:
+    void sinkLoop();
+    void writeSamples(const short *samples, unsigned int count);
+    void writeHeader(unsigned long long dataBytes);
+
+    CHIP8_AUDIO_RING &ring;
+    unsigned int sampleRate;
+    std::ofstream outFile;
+    std::thread worker;
+    std::atomic<bool> stopping;
+    bool realTime;
+    std::vector<short> buffer;                          //samples taken from the ring per wakeup
+    std::vector<unsigned char> encoded;                 //the same samples as written to the file
+    unsigned long long samplesWritten;
+    int status;
+};
@@ -0,0 +1,377 @@
+/* Chip 8 Emulator  <chip8_batch.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include "chip8_batch.h"
+#include "chip8_rom_cache.h"
+
+using namespace std;
+
+CHIP8_BATCH_RUNNER::CHIP8_BATCH_RUNNER(unsigned int threadCount)
+{
+    if(threadCount == 0)
+    {
+        threadCount = thread::hardware_concurrency();
+        if(threadCount == 0)
+        {   //not computable on this platform
+            threadCount = 1;
+        }
+    }
+    this -> threadCount = threadCount;
+    useBlocks = false;
+    deduplicate = false;
+    reusedResults = 0;
+    skippedCycles = 0;
+    resultCallback = NULL;
+    resultContext = NULL;
+}
+
+CHIP8_BATCH_RUNNER::~CHIP8_BATCH_RUNNER()
+{
+    for(unsigned int i = 0; i < queues.size(); i++)
+    {
+        delete queues[i];
+    }
+}
+
+unsigned int CHIP8_BATCH_RUNNER::getThreadCount()
+{
+    return threadCount;
+}
+
+void CHIP8_BATCH_RUNNER::setUseBlocks(bool enabled)
+{
+    useBlocks = enabled;
+}
+
+void CHIP8_BATCH_RUNNER::setDeduplicate(bool enabled)
+{
+    deduplicate = enabled;
+}
+
+unsigned long CHIP8_BATCH_RUNNER::getReusedResultCount()
+{
+    return reusedResults;
+}
+
+unsigned long long CHIP8_BATCH_RUNNER::getSkippedCycleCount()
+{
+    return skippedCycles;
+}
+
+unsigned long CHIP8_BATCH_RUNNER::getStateCount()
+{
+    return states.getStateCount();
+}
+
+int CHIP8_BATCH_RUNNER::loadManifest(const char *filename)
+{
+    ifstream manifest(filename);
+    if(!manifest.is_open())
+    {
+        cerr << "Unable to open batch manifest " << filename << endl;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+
+    string line;
+    while(getline(manifest, line))
+    {
+        size_t comment = line.find('#');
+        if(comment != string::npos)
+        {
+            line.erase(comment);
+        }
+        istringstream fields(line);
+        string romPath;
+        if(!(fields >> romPath))
+        {   //blank line
+            continue;
+        }
+        unsigned long long seed = 0;
+        unsigned long cycles = DEFAULT_BATCH_CYCLES;
+        fields >> seed >> cycles;
+
+        vector<string> members;
+        if(CHIP8_ROM_CACHE::getInstance().listArchive(romPath, members) == STATUS_SUCCESS)
+        {   //a whole archive: one job per ROM inside it
+            for(unsigned int i = 0; i < members.size(); i++)
+            {
+                addJob(members[i], seed, cycles);
+            }
+            continue;
+        }
+        addJob(romPath, seed, cycles);
+    }
+    return STATUS_SUCCESS;
+}
+
+void CHIP8_BATCH_RUNNER::addJob(const string &romPath, unsigned long long seed, unsigned long cycleBudget)
+{
+    BATCH_JOB job;
+    job.jobId = pendingJobs.size();
+    job.romPath = romPath;
+    job.seed = seed;
+    job.cycleBudget = cycleBudget;
+    pendingJobs.push_back(job);
+}
+
+int CHIP8_BATCH_RUNNER::run(BATCH_RESULT_CALLBACK onResult, void *context)
+{
+    resultCallback = onResult;
+    resultContext = context;
+
+    for(unsigned int i = 0; i < queues.size(); i++)
+    {
+        delete queues[i];
+    }
+    queues.clear();
+    for(unsigned int i = 0; i < threadCount; i++)
+    {
+        queues.push_back(new WORK_QUEUE());
+    }
+    //deal jobs out round robin, stealing evens out whatever imbalance the ROMs cause
+    for(unsigned int i = 0; i < pendingJobs.size(); i++)
+    {
+        queues[i % threadCount]->jobs.push_back(pendingJobs[i]);
+    }
+    //job ids restart with every manifest, and so do the states they reached
+    outcomes.assign(pendingJobs.size(), JOB_OUTCOME());
+    states.clear();
+    pendingJobs.clear();
+
+    vector<thread> workers;
+    for(unsigned int i = 0; i < threadCount; i++)
+    {
+        workers.push_back(thread(&CHIP8_BATCH_RUNNER::workerLoop, this, i));
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    return STATUS_SUCCESS;
+}
+
+bool CHIP8_BATCH_RUNNER::takeJob(unsigned int workerId, BATCH_JOB &job)
+{
+    {
+        WORK_QUEUE *own = queues[workerId];
+        lock_guard<mutex> guard(own->lock);
+        if(!own->jobs.empty())
+        {
+            job = own->jobs.back();
+            own->jobs.pop_back();
+            return true;
+        }
+    }
+    for(unsigned int i = 1; i < threadCount; i++)
+    {   //own queue is dry, steal the oldest job of the next worker that has one
+        WORK_QUEUE *victim = queues[(workerId + i) % threadCount];
+        lock_guard<mutex> guard(victim->lock);
+        if(!victim->jobs.empty())
+        {
+            job = victim->jobs.front();
+            victim->jobs.pop_front();
+            return true;
+        }
+    }
+    return false;   //no job is ever added while running, so empty everywhere means done
+}
+
+void CHIP8_BATCH_RUNNER::workerLoop(unsigned int workerId)
+{
+    //one machine per worker, reused between jobs so nothing is allocated per ROM
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    CHIP8_ANALYZER *analyzer = deduplicate ? new CHIP8_ANALYZER() : NULL;
+    BATCH_JOB job;
+    while(takeJob(workerId, job))
+    {
+        BATCH_RESULT result;
+        runJob(*emulator, analyzer, job, result);
+        if(resultCallback != NULL)
+        {
+            lock_guard<mutex> guard(resultLock);
+            resultCallback(result, resultContext);
+        }
+    }
+    delete analyzer;
+    delete emulator;
+}
+
+void CHIP8_BATCH_RUNNER::runJob(CHIP8_EMULATOR &emulator, CHIP8_ANALYZER *analyzer, const BATCH_JOB &job, BATCH_RESULT &result)
+{
+    result.jobId = job.jobId;
+    result.romPath = job.romPath;
+    result.seed = job.seed;
+    result.cycles = 0;
+    result.stateHash = 0;
+
+    char romFilename[MAX_FILENAME_LEN];
+    strncpy(romFilename, job.romPath.c_str(), MAX_FILENAME_LEN - 1);
+    romFilename[MAX_FILENAME_LEN - 1] = '\0';
+
+    emulator.initEmulator();
+    emulator.seedRNG(job.seed);
+    result.status = emulator.loadROM(romFilename);
+    if(result.status != STATUS_SUCCESS)
+    {
+        result.exitReason = BATCH_EXIT_LOAD_FAILED;
+        return;
+    }
+
+    //the timers tick at the same frame boundaries as in a headless run, so a job ends in the state --headless reaches
+    CHIP8_SCHEDULER scheduler(emulator);
+    if(deduplicate)
+    {
+        if(!runDeduplicated(scheduler, emulator, *analyzer, job, result))
+        {
+            result.stateHash = emulator.getStateHash();
+        }
+    }
+    else
+    {
+        scheduler.setUseBlocks(useBlocks);
+        unsigned long long executed = 0;
+        result.status = scheduler.run(job.cycleBudget, &executed);
+        result.cycles = executed;
+        result.stateHash = emulator.getStateHash();
+    }
+    result.exitReason = (result.status == STATUS_SUCCESS) ? BATCH_EXIT_BUDGET : BATCH_EXIT_ERROR;
+    if(deduplicate)
+    {
+        lock_guard<mutex> guard(outcomeLock);
+        JOB_OUTCOME &outcome = outcomes[job.jobId];
+        outcome.status = result.status;
+        outcome.cycles = result.cycles;
+        outcome.stateHash = result.stateHash;
+        outcome.done = true;
+    }
+}
+
+bool CHIP8_BATCH_RUNNER::runDeduplicated(CHIP8_SCHEDULER &scheduler, CHIP8_EMULATOR &emulator, CHIP8_ANALYZER &analyzer, const BATCH_JOB &job, BATCH_RESULT &result)
+{
+    //another seed only leads to the same state if the ROM can never draw a random number
+    const bool withRNG = romUsesRNG(job.romPath, analyzer);
+    unordered_map<unsigned long long, STATE_SIGHTING> ownStates;   //this job's checkpoints by state
+    unsigned long executed = 0;
+    result.status = STATUS_SUCCESS;
+    while(executed < job.cycleBudget)
+    {
+        //the Zobrist key finds candidates, the FNV state hash has to agree as well before a state counts as seen
+        const unsigned long long key = emulator.getZobristHash(withRNG);
+        STATE_SIGHTING here = { job.jobId, executed, emulator.getStateHash() };
+        pair<unordered_map<unsigned long long, STATE_SIGHTING>::iterator, bool> own = ownStates.insert(make_pair(key, here));
+        if(!own.second && own.first->second.stateHash == here.stateHash)
+        {   //both checkpoints sit on a frame boundary, the timers are part of the state and there are no keys: the run is
+            //periodic from here, only the last partial period is run (the scheduler falls behind by whole frames only)
+            const unsigned long period = executed - own.first->second.cycle;
+            const unsigned long skipped = (job.cycleBudget - executed) / period * period;
+            executed += skipped;
+            skippedCycles += skipped;
+            unsigned long long tail = 0;
+            result.status = scheduler.run(job.cycleBudget - executed, &tail);
+            executed += tail;
+            break;
+        }
+        //shared under the instructions left as well: only a job with the same number left ends where the first one did,
+        //and every job's checkpoints sit on frame boundaries, so the timer ticks ahead line up too
+        STATE_SIGHTING first;
+        const unsigned long long sharedKey = key ^ zobristMix(job.cycleBudget - executed);
+        if(!states.findOrInsert(sharedKey, here, &first) && first.jobId != job.jobId && first.stateHash == here.stateHash &&
+           reuseOutcome(first, executed, job.cycleBudget, result))
+        {
+            reusedResults++;
+            skippedCycles += result.cycles - executed;
+            return true;
+        }
+        unsigned long chunk = job.cycleBudget - executed;
+        if(chunk > DEDUP_CHECK_INTERVAL)
+        {
+            chunk = DEDUP_CHECK_INTERVAL;
+        }
+        unsigned long long ran = 0;
+        result.status = scheduler.run(chunk, &ran);
+        executed += ran;
+        if(result.status != STATUS_SUCCESS)
+        {
+            break;
+        }
+    }
+    result.cycles = executed;
+    return false;
+}
+
+bool CHIP8_BATCH_RUNNER::reuseOutcome(const STATE_SIGHTING &first, unsigned long cycle, unsigned long cycleBudget, BATCH_RESULT &result)
+{
+    JOB_OUTCOME outcome;
+    {
+        lock_guard<mutex> guard(outcomeLock);
+        outcome = outcomes[first.jobId];
+    }
+    if(!outcome.done)
+    {   //still running, this job carries on by itself
+        return false;
+    }
+    //from the shared state on, the first job ran ownerRest more instructions before its budget or an error stopped it
+    const unsigned long ownerRest = outcome.cycles - first.cycle;
+    if(outcome.status == STATUS_SUCCESS ? ownerRest != cycleBudget - cycle : ownerRest > cycleBudget - cycle)
+    {   //a different budget would stop this job somewhere else
+        return false;
+    }
+    result.status = outcome.status;
+    result.cycles = cycle + ownerRest;
+    result.stateHash = outcome.stateHash;
+    return true;
+}
+
+bool CHIP8_BATCH_RUNNER::romUsesRNG(const string &romPath, CHIP8_ANALYZER &analyzer)
+{
+    shared_ptr<const CHIP8_ROM_IMAGE> image;
+    if(CHIP8_ROM_CACHE::getInstance().getROM(romPath, image) != STATUS_SUCCESS)
+    {
+        return true;
+    }
+    {
+        lock_guard<mutex> guard(rngLock);
+        map<unsigned long long, bool>::iterator known = rngUse.find(image->contentHash);
+        if(known != rngUse.end())
+        {
+            return known->second;
+        }
+    }
+    bool usesRNG = true;
+    CHIP8_ROM_ANALYSIS analysis;
+    if(analyzer.analyze(*image, PLATFORM_CHIP8, analysis) == STATUS_SUCCESS && analysis.isComplete() && analysis.selfModifyingWrites.empty())
+    {   //every instruction that can ever run is known
+        usesRNG = false;
+        for(unsigned int i = 0; i < analysis.instructions.size(); i++)
+        {
+            if((image->memory.read(analysis.instructions[i]) & 0xF0) == 0xC0)
+            {
+                usesRNG = true;
+                break;
+            }
+        }
+    }
+    lock_guard<mutex> guard(rngLock);
+    rngUse[image->contentHash] = usesRNG;
+    return usesRNG;
+}
@@ -0,0 +1,111 @@
+/* Chip 8 Emulator  <chip8_batch.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "chip8.h"
+#include "chip8_analyzer.h"
+#include "chip8_scheduler.h"
+#include "chip8_state_table.h"
+
+#define DEFAULT_BATCH_CYCLES        1000000     //instruction budget for manifest lines that do not give one
+#define DEDUP_CHECK_INTERVAL        (400 * (DEFAULT_CPU_CLOCK / TIMER_FREQUENCY))  //instructions between the state lookups of a deduplicated job, whole frames
+
+#define BATCH_EXIT_BUDGET           0           //ran the whole instruction budget
+#define BATCH_EXIT_ERROR            1           //emulator returned an error (see BATCH_RESULT::status)
+#define BATCH_EXIT_LOAD_FAILED      2           //ROM could not be loaded
+
+struct BATCH_JOB
+{
+    unsigned int jobId;                         //line order in the manifest
+    std::string romPath;
+    unsigned long long seed;                    //RNG seed for CXNN
+    unsigned long cycleBudget;                  //instructions to run, in 60hz frames of DEFAULT_CPU_CLOCK like a headless run
+};
+
+struct BATCH_RESULT
+{
+    unsigned int jobId;
+    std::string romPath;
+    unsigned long long seed;
+    int exitReason;                             //one of BATCH_EXIT_*
+    int status;                                 //emulator status code that ended the run
+    unsigned long cycles;                       //instructions actually executed
+    unsigned long long stateHash;               //CHIP8_EMULATOR::getStateHash() at the end of the run
+};
+
+typedef void (*BATCH_RESULT_CALLBACK)(const BATCH_RESULT &result, void *context);
+
+class CHIP8_BATCH_RUNNER
+{
+    public:
+    CHIP8_BATCH_RUNNER(unsigned int threadCount = 0);  //0 = one worker per hardware thread
+    ~CHIP8_BATCH_RUNNER();
+
+    int loadManifest(const char *filename);             //one job per line: <rom path> [seed] [cycles], '#' starts a comment, an archive expands to all its ROMs
+    void addJob(const std::string &romPath, unsigned long long seed, unsigned long cycleBudget);
+    int run(BATCH_RESULT_CALLBACK onResult, void *context);    //runs every job, onResult is called (serialized) as each one finishes
+    unsigned int getThreadCount();
+    void setUseBlocks(bool enabled);                    //run jobs on translated blocks instead of the interpreter
+    void setDeduplicate(bool enabled);                  //share reached states between jobs (interpreter only), a state matches when two independent 64-bit hashes do
+    unsigned long getReusedResultCount();               //jobs that took the result of a job that had been in the same state
+    unsigned long long getSkippedCycleCount();          //instructions counted as executed without being run
+    unsigned long getStateCount();                      //distinct states in the shared table
+
+    private:
+    struct WORK_QUEUE                                   //one per worker, the owner pops the back and thieves take the front
+    {
+        std::mutex lock;
+        std::deque<BATCH_JOB> jobs;
+    };
+
+    void workerLoop(unsigned int workerId);
+    bool takeJob(unsigned int workerId, BATCH_JOB &job);  //own queue first, then steal from the others
+    struct JOB_OUTCOME                                  //how a finished job ended, for the jobs that reach one of its states later
+    {
+        bool done;
+        int status;
+        unsigned long cycles;
+        unsigned long long stateHash;
+    };
+
+    void runJob(CHIP8_EMULATOR &emulator, CHIP8_ANALYZER *analyzer, const BATCH_JOB &job, BATCH_RESULT &result);
+    bool runDeduplicated(CHIP8_SCHEDULER &scheduler, CHIP8_EMULATOR &emulator, CHIP8_ANALYZER &analyzer, const BATCH_JOB &job, BATCH_RESULT &result);  //true when the result was taken from another job
+    bool reuseOutcome(const STATE_SIGHTING &first, unsigned long cycle, unsigned long cycleBudget, BATCH_RESULT &result);
+    bool romUsesRNG(const std::string &romPath, CHIP8_ANALYZER &analyzer);  //false when no reachable code can ever run CXNN
+
+    unsigned int threadCount;
+    bool useBlocks;
+    bool deduplicate;
+    CHIP8_STATE_TABLE states;                           //getZobristHash() at every DEDUP_CHECK_INTERVAL of every job
+    std::mutex outcomeLock;
+    std::vector<JOB_OUTCOME> outcomes;                  //by job id
+    std::mutex rngLock;
+    std::map<unsigned long long, bool> rngUse;          //romUsesRNG() by ROM content hash
+    std::atomic<unsigned long> reusedResults;
+    std::atomic<unsigned long long> skippedCycles;
+    std::vector<BATCH_JOB> pendingJobs;
+    std::vector<WORK_QUEUE*> queues;
+    std::mutex resultLock;                              //serializes the result callback
+    BATCH_RESULT_CALLBACK resultCallback;
+    void *resultContext;
+};
@@ -0,0 +1,372 @@
+/* Chip 8 Emulator  <chip8_bench.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Microbenchmarks of the hot path, built by 'make bench' (needs Google Benchmark).  Every benchmark that executes
+ * instructions reports MIPS and ns_per_instruction counters; 'make bench' writes them to bench.json so runs of
+ * different commits can be compared.  With --write-rom=FILE the binary writes a synthetic ROM instead of running.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include "chip8.h"
+#include "chip8_rom_cache.h"
+#include "chip8_romgen.h"
+#include "chip8_display.h"
+#include "chip8_audio.h"
+
+#define THROUGHPUT_SLICE        (1UL << 14)     //instructions run per benchmark iteration of whole-ROM throughput
+#define FETCH_WINDOW            512             //fetches before the PC is moved back to the start of the ROM
+
+using namespace std;
+
+static void setInstructionCounters(benchmark::State &state, double instructions)
+{
+    state.SetItemsProcessed((int64_t) instructions);
+    state.counters["MIPS"] = benchmark::Counter(instructions / 1e6, benchmark::Counter::kIsRate);
+    state.counters["ns_per_instruction"] = benchmark::Counter(instructions / 1e9, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+static void buildImage(CHIP8_ROM_GENERATOR &generator, CHIP8_ROM_IMAGE &image)
+{
+    vector<unsigned char> rom;
+    generator.generate(rom);
+    image.name = "synthetic";
+    image.size = rom.size();
+    image.contentHash = 0;
+    CHIP8_EMULATOR::initMemory(image.memory);
+    image.memory.load(BASE_RAM_OFFSET, rom.data(), rom.size());
+}
+
+static void buildImage(const char *mix, unsigned int branchPattern, CHIP8_ROM_IMAGE &image)
+{
+    CHIP8_ROM_GENERATOR generator;
+    for(unsigned int f = 0; f < ROMGEN_FAMILY_COUNT; f++)
+    {
+        generator.setWeight(f, 0);  //only what the mix names
+    }
+    generator.setMix(mix);
+    generator.setBranchPattern(branchPattern);
+    buildImage(generator, image);
+}
+
+static void BM_FetchInstruction(benchmark::State &state)
+{
+    CHIP8_ROM_IMAGE image;
+    buildImage("alu=1", ROMGEN_BRANCH_NEVER, image);
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    emulator->initEmulator();
+    emulator->loadROM(image);
+
+    unsigned int fetched = 0;
+    for(auto _ : state)
+    {
+        if(++fetched == FETCH_WINDOW)
+        {   //stay inside the ROM so every fetch is one of its instructions
+            emulator->positionPC();
+            fetched = 0;
+        }
+        benchmark::DoNotOptimize(emulator->fetchInstruction());
+    }
+    setInstructionCounters(state, state.iterations());
+    delete emulator;
+}
+BENCHMARK(BM_FetchInstruction);
+
+/*
+ * decodeAndExecuteInstruction() on one opcode over and over: decode plus handler, no fetch or dispatch through the
+ * decode cache.  setup runs once first (e.g. pointing I at the data area for FX55/FX65).
+ */
+static void BM_DecodeAndExecute(benchmark::State &state, ushort opcode, ushort setup)
+{
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    emulator->initEmulator();
+    emulator->decodeAndExecuteInstruction(0x6000);      //V0 = 0, the skips compare against it
+    emulator->decodeAndExecuteInstruction(0x6107);
+    emulator->decodeAndExecuteInstruction(0x6203);
+    emulator->decodeAndExecuteInstruction(setup);
+    emulator->positionPC();
+
+    unsigned int executed = 0;
+    for(auto _ : state)
+    {
+        if(++executed == FETCH_WINDOW)
+        {   //taken skips keep moving the PC
+            emulator->positionPC();
+            executed = 0;
+        }
+        benchmark::DoNotOptimize(emulator->decodeAndExecuteInstruction(opcode));
+    }
+    setInstructionCounters(state, state.iterations());
+    delete emulator;
+}
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, alu_8xy0, 0x8120, 0x6000);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, alu_8xy4, 0x8124, 0x6000);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, alu_8xy5, 0x8125, 0x6000);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, alu_8xye, 0x812E, 0x6000);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, skip_3xnn_taken, 0x3000, 0x6000);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, skip_3xnn_not_taken, 0x3001, 0x6000);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, skip_9xy0_taken, 0x9010, 0x6000);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, fx55_8_registers, 0xF755, 0xA000 | ROMGEN_DATA_ADDRESS);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, fx65_8_registers, 0xF765, 0xA000 | ROMGEN_DATA_ADDRESS);
+BENCHMARK_CAPTURE(BM_DecodeAndExecute, dxyn_5_rows, 0xD125, 0xF029);
+
+/*
+ * Whole-ROM throughput on generated programs, through the interpreter loop (runInstructions) or translated blocks
+ * (runBlocks).  mix and branchPattern are CHIP8_ROM_GENERATOR settings, every other family weight is zero.
+ */
+static void BM_RomThroughput(benchmark::State &state, const char *mix, unsigned int branchPattern, bool useBlocks)
+{
+    CHIP8_ROM_IMAGE image;
+    buildImage(mix, branchPattern, image);
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    emulator->initEmulator();
+    emulator->seedRNG(0);
+    emulator->loadROM(image);
+
+    double instructions = 0;
+    for(auto _ : state)
+    {
+        unsigned long executed = 0;
+        int status = useBlocks ? emulator->runBlocks(THROUGHPUT_SLICE, &executed) : emulator->runInstructions(THROUGHPUT_SLICE, &executed);
+        instructions += executed;
+        if(status != STATUS_SUCCESS)
+        {
+            state.SkipWithError("generated ROM stopped with an error");
+            break;
+        }
+    }
+    setInstructionCounters(state, instructions);
+    delete emulator;
+}
+
+#define ROM_THROUGHPUT(name, mix, branchPattern) \
+    BENCHMARK_CAPTURE(BM_RomThroughput, name##_interpreter, mix, branchPattern, false); \
+    BENCHMARK_CAPTURE(BM_RomThroughput, name##_blocks, mix, branchPattern, true)
+
+ROM_THROUGHPUT(alu, "alu=1", ROMGEN_BRANCH_NEVER);
+ROM_THROUGHPUT(load, "load=1", ROMGEN_BRANCH_NEVER);
+ROM_THROUGHPUT(skips_never, "alu=50,load=20,skip=30", ROMGEN_BRANCH_NEVER);
+ROM_THROUGHPUT(skips_always, "alu=50,load=20,skip=30", ROMGEN_BRANCH_ALWAYS);
+ROM_THROUGHPUT(skips_alternating, "alu=50,load=20,skip=30", ROMGEN_BRANCH_ALTERNATING);
+ROM_THROUGHPUT(skips_random, "alu=50,load=20,skip=30", ROMGEN_BRANCH_RANDOM);
+ROM_THROUGHPUT(memory, "alu=50,memory=50", ROMGEN_BRANCH_NEVER);
+ROM_THROUGHPUT(draw, "alu=50,draw=50", ROMGEN_BRANCH_NEVER);
+ROM_THROUGHPUT(calls, "alu=70,call=30", ROMGEN_BRANCH_NEVER);
+ROM_THROUGHPUT(mixed, "alu=40,load=20,skip=15,memory=10,draw=5,random=5,call=5", ROMGEN_BRANCH_ALTERNATING);
+
+static void BM_LoadROMImage(benchmark::State &state)
+{
+    CHIP8_ROM_IMAGE image;
+    buildImage("alu=40,load=20,skip=15,memory=10,draw=5,random=5,call=5", ROMGEN_BRANCH_ALTERNATING, image);
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    emulator->initEmulator();
+    for(auto _ : state)
+    {
+        emulator->loadROM(image);
+    }
+    delete emulator;
+}
+BENCHMARK(BM_LoadROMImage);
+
+/*
+ * loadROM(filename) on a generated ROM written to a temporary file.  Cached: every load after the first is a cache
+ * hit.  Uncached: the ROM cache is cleared inside the timed loop, so each load opens, maps and hashes the file.
+ */
+static void BM_LoadROMFile(benchmark::State &state, bool cached)
+{
+    char filename[MAX_FILENAME_LEN] = "/tmp/chip8_bench_XXXXXX";
+    int fd = mkstemp(filename);
+    if(fd < 0)
+    {
+        state.SkipWithError("unable to create a temporary ROM file");
+        return;
+    }
+    CHIP8_ROM_GENERATOR generator;
+    vector<unsigned char> rom;
+    generator.generate(rom);
+    bool written = write(fd, rom.data(), rom.size()) == (ssize_t) rom.size();
+    close(fd);
+
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    emulator->initEmulator();
+    CHIP8_ROM_CACHE &cache = CHIP8_ROM_CACHE::getInstance();
+    cache.clear();
+    for(auto _ : state)
+    {
+        if(!cached)
+        {
+            cache.clear();
+        }
+        if(!written || emulator->loadROM(filename) != STATUS_SUCCESS)
+        {
+            state.SkipWithError("unable to load the temporary ROM file");
+            break;
+        }
+    }
+    cache.clear();
+    unlink(filename);
+    delete emulator;
+}
+BENCHMARK_CAPTURE(BM_LoadROMFile, cached, true);
+BENCHMARK_CAPTURE(BM_LoadROMFile, uncached, false);
+
+static void BM_InitEmulator(benchmark::State &state)
+{
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    for(auto _ : state)
+    {
+        emulator->initEmulator();
+    }
+    delete emulator;
+}
+BENCHMARK(BM_InitEmulator);
+
+/*
+ * One display frame handed to a reader through CHIP8_TRIPLE_BUFFER after draw dirtied part of the screen: publish
+ * copies only the stale rows of the slot it fills, and the reader takes every frame so the slots keep rotating.
+ */
+static void BM_PublishFrame(benchmark::State &state, ushort draw)
+{
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    emulator->initEmulator();
+    emulator->decodeAndExecuteInstruction(0xF029);      //I at the font, V0 = V1 = 0
+    CHIP8_TRIPLE_BUFFER *display = new CHIP8_TRIPLE_BUFFER();
+    unsigned long long frame = 0;
+    for(auto _ : state)
+    {
+        emulator->decodeAndExecuteInstruction(draw);
+        display->publish(*emulator, frame++);
+        benchmark::DoNotOptimize(display->acquire());
+    }
+    state.counters["rows_per_frame"] = benchmark::Counter((double) display->getCopiedRows() / state.iterations());
+    delete display;
+    delete emulator;
+}
+BENCHMARK_CAPTURE(BM_PublishFrame, dxyn_5_rows, 0xD015);
+BENCHMARK_CAPTURE(BM_PublishFrame, clear_screen, 0x00E0);
+
+/*
+ * One frame of samples rendered into a CHIP8_AUDIO_RING and taken out again, as the scheduler does at every frame
+ * boundary with --audio: silent frames only fill the block, sounding ones run the pattern for every sample.
+ */
+static void BM_RenderAudioFrame(benchmark::State &state, unsigned int platform, unsigned char sound)
+{
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    emulator->initEmulator();
+    emulator->setPlatform(platform);
+    emulator->decodeAndExecuteInstruction(0x6000 | sound);  //V0 = sound
+    CHIP8_AUDIO_RING *ring = new CHIP8_AUDIO_RING();
+    CHIP8_AUDIO_SYNTH synth(*ring);
+    vector<short> samples(AUDIO_SAMPLE_RATE / TIMER_FREQUENCY + 1);
+    for(auto _ : state)
+    {
+        emulator->decodeAndExecuteInstruction(0xF018);  //sound timer = V0, it never gets ticked down here
+        synth.renderFrame(*emulator);
+        benchmark::DoNotOptimize(ring->read(samples.data(), samples.size()));
+    }
+    state.SetItemsProcessed(synth.getSampleCount());
+    delete ring;
+    delete emulator;
+}
+BENCHMARK_CAPTURE(BM_RenderAudioFrame, silent, PLATFORM_CHIP8, 0);
+BENCHMARK_CAPTURE(BM_RenderAudioFrame, beep, PLATFORM_CHIP8, 60);
+BENCHMARK_CAPTURE(BM_RenderAudioFrame, xochip_pattern, PLATFORM_XOCHIP, 60);
+
+static void printUsage(const char *programName)
+{
+    cerr << "Usage: " << programName << " [benchmark options]" << endl
+         << "       " << programName << " --write-rom=FILE [--mix=M] [--branches=P] [--length=N] [--seed=S]" << endl
+         << "  --write-rom=FILE  write a synthetic ROM to FILE instead of running benchmarks" << endl
+         << "  --mix=M           family weights, e.g. alu=60,load=20,skip=10,memory=5,draw=3,random=1,call=1" << endl
+         << "  --branches=P      skip outcomes: never, always, alternating or random" << endl
+         << "  --length=N        instructions in the loop body (at most " << ROMGEN_MAX_LENGTH << ")" << endl
+         << "  --seed=S          generator seed, the same settings and seed give the same ROM" << endl
+         << "Run with --help for the Google Benchmark options (--benchmark_filter, --benchmark_out, ...)." << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    CHIP8_ROM_GENERATOR generator;
+    const char *romFilename = NULL;
+    int benchmarkArgc = 1;
+
+    for(int i = 1; i < argc; i++)
+    {
+        int returnValue = STATUS_SUCCESS;
+        if(strncmp(argv[i], "--write-rom=", 12) == 0)
+        {
+            romFilename = argv[i] + 12;
+        }
+        else if(strncmp(argv[i], "--mix=", 6) == 0)
+        {
+            returnValue = generator.setMix(argv[i] + 6);
+        }
+        else if(strncmp(argv[i], "--branches=", 11) == 0)
+        {
+            returnValue = generator.setBranchPattern(argv[i] + 11);
+        }
+        else if(strncmp(argv[i], "--length=", 9) == 0)
+        {
+            generator.setLength(strtoul(argv[i] + 9, NULL, 0));
+        }
+        else if(strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            generator.setSeed(strtoull(argv[i] + 7, NULL, 0));
+        }
+        else
+        {   //everything else is for Google Benchmark
+            argv[benchmarkArgc++] = argv[i];
+        }
+        if(returnValue != STATUS_SUCCESS)
+        {
+            printUsage(argv[0]);
+            return returnValue;
+        }
+    }
+
+    if(romFilename != NULL)
+    {
+        vector<unsigned char> rom;
+        generator.generate(rom);
+        ofstream romFile(romFilename, ios::binary | ios::trunc);
+        romFile.write((const char *) rom.data(), rom.size());
+        romFile.close();
+        if(romFile.fail())
+        {
+            cerr << "Unable to write ROM file!" << endl;
+            return ERR_UNABLE_OPEN_FILE;
+        }
+        cout << "Wrote " << rom.size() << " bytes to " << romFilename << endl;
+        return STATUS_SUCCESS;
+    }
+
+    argc = benchmarkArgc;
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        printUsage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/* Chip 8 Emulator  <chip8_display.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "chip8_display.h"
+
+using namespace std;
+
+static const unsigned char framePalette[4][3] =     //RGB per pixel color (plane 0 bit plus twice the plane 1 bit)
+{
+    { 0x00, 0x00, 0x00 },
+    { 0xFF, 0xFF, 0xFF },
+    { 0xAA, 0xAA, 0xAA },
+    { 0x55, 0x55, 0x55 }
+};
+
+uint64_t CHIP8_FRAME::getChangedRows(unsigned int sinceVersion) const
+{
+    uint64_t changed = 0;
+    for(unsigned int y = 0; y < HIRES_GFX_HEIGHT; y++)
+    {
+        changed |= (uint64_t) (rowVersion[y] > sinceVersion) << y;
+    }
+    return changed;
+}
+
+CHIP8_TRIPLE_BUFFER::CHIP8_TRIPLE_BUFFER()
+{
+    memset(slots, 0, sizeof(slots));
+    writeSlot = 0;
+    sharedSlot.store(1);
+    readSlot = 2;
+    version = 0;
+    memset(rowVersion, 0, sizeof(rowVersion));
+    published = 0;
+    dropped = 0;
+    copiedRows = 0;
+}
+
+bool CHIP8_TRIPLE_BUFFER::publish(CHIP8_EMULATOR &emulator, unsigned long long frameNumber)
+{
+    uint64_t dirty = emulator.takeDirtyRows();
+    if(dirty == 0)
+    {   //the reader already has this picture (a resolution change dirties every row)
+        return false;
+    }
+    version++;
+    for(uint64_t rows = dirty; rows != 0; rows &= rows - 1)
+    {
+        rowVersion[__builtin_ctzll(rows)] = version;
+    }
+
+    //the slot last held a frame two or more publishes ago, bring just its stale rows up to date
+    CHIP8_FRAME &frame = slots[writeSlot];
+    uint64_t stale = 0;
+    for(unsigned int y = 0; y < HIRES_GFX_HEIGHT; y++)
+    {
+        stale |= (uint64_t) (frame.rowVersion[y] != rowVersion[y]) << y;
+    }
+    emulator.copyFrameRows(frame.rows, stale);
+    copiedRows += __builtin_popcountll(stale);
+    memcpy(frame.rowVersion, rowVersion, sizeof(rowVersion));
+    frame.frameNumber = frameNumber;
+    frame.version = version;
+    frame.width = emulator.getDisplayWidth();
+    frame.height = emulator.getDisplayHeight();
+
+    //release: the reader that takes this slot sees everything written above
+    unsigned int previous = sharedSlot.exchange(writeSlot | FRAME_SLOT_FRESH, memory_order_acq_rel);
+    writeSlot = previous & ~FRAME_SLOT_FRESH;
+    published++;
+    if(previous & FRAME_SLOT_FRESH)
+    {
+        dropped++;
+    }
+    return true;
+}
+
+const CHIP8_FRAME *CHIP8_TRIPLE_BUFFER::acquire()
+{
+    if(!(sharedSlot.load(memory_order_relaxed) & FRAME_SLOT_FRESH))
+    {
+        return NULL;
+    }
+    unsigned int previous = sharedSlot.exchange(readSlot, memory_order_acq_rel);
+    readSlot = previous & ~FRAME_SLOT_FRESH;
+    return &slots[readSlot];
+}
+
+unsigned long long CHIP8_TRIPLE_BUFFER::getPublishedCount()
+{
+    return published;
+}
+
+unsigned long long CHIP8_TRIPLE_BUFFER::getDroppedCount()
+{
+    return dropped;
+}
+
+unsigned long long CHIP8_TRIPLE_BUFFER::getCopiedRows()
+{
+    return copiedRows;
+}
+
+CHIP8_FRAME_DUMPER::CHIP8_FRAME_DUMPER(CHIP8_TRIPLE_BUFFER &frames, const char *prefix) : frames(frames), prefix(prefix)
+{
+    stopping.store(false);
+    width = 0;
+    lastVersion = 0;
+    framesWritten = 0;
+    rowsConverted = 0;
+    status = STATUS_SUCCESS;
+}
+
+CHIP8_FRAME_DUMPER::~CHIP8_FRAME_DUMPER()
+{
+    stop();
+}
+
+void CHIP8_FRAME_DUMPER::start()
+{
+    if(!worker.joinable())
+    {
+        stopping.store(false);
+        worker = thread(&CHIP8_FRAME_DUMPER::dumpLoop, this);
+    }
+}
+
+void CHIP8_FRAME_DUMPER::stop()
+{
+    if(!worker.joinable())
+    {
+        return;
+    }
+    stopping.store(true);
+    worker.join();
+    const CHIP8_FRAME *frame = frames.acquire();    //the emulation thread is done, the last frame may still be waiting
+    if(frame != NULL)
+    {
+        dumpFrame(*frame);
+    }
+}
+
+unsigned long long CHIP8_FRAME_DUMPER::getFramesWritten()
+{
+    return framesWritten;
+}
+
+unsigned long long CHIP8_FRAME_DUMPER::getRowsConverted()
+{
+    return rowsConverted;
+}
+
+int CHIP8_FRAME_DUMPER::getStatus()
+{
+    return status;
+}
+
+void CHIP8_FRAME_DUMPER::dumpLoop()
+{
+    while(!stopping.load())
+    {
+        const CHIP8_FRAME *frame = frames.acquire();
+        if(frame == NULL)
+        {
+            this_thread::sleep_for(chrono::microseconds(FRAME_DUMP_POLL_US));
+            continue;
+        }
+        dumpFrame(*frame);
+    }
+}
+
+void CHIP8_FRAME_DUMPER::dumpFrame(const CHIP8_FRAME &frame)
+{
+    uint64_t changed = frame.getChangedRows(lastVersion);
+    if(frame.width != width)
+    {   //resolution changed, the whole image is redrawn
+        width = frame.width;
+        image.assign(frame.width * frame.height * 3, 0);
+        changed = ~0ULL;
+    }
+    if(frame.height < HIRES_GFX_HEIGHT)
+    {
+        changed &= (1ULL << frame.height) - 1;
+    }
+    for(; changed != 0; changed &= changed - 1)
+    {
+        unsigned int y = __builtin_ctzll(changed);
+        unsigned char *pixel = &image[y * width * 3];
+        for(unsigned int x = 0; x < width; x++, pixel += 3)
+        {
+            unsigned int color = 0;
+            for(unsigned int plane = 0; plane < GFX_PLANE_COUNT; plane++)
+            {
+                color |= ((frame.rows[plane][x / 64][y] >> (63 - x % 64)) & 1) << plane;
+            }
+            memcpy(pixel, framePalette[color], 3);
+        }
+        rowsConverted++;
+    }
+    lastVersion = frame.version;
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%06llu.ppm", frame.frameNumber);
+    ofstream out((prefix + suffix).c_str(), ios::binary | ios::trunc);
+    out << "P6\n" << frame.width << ' ' << frame.height << "\n255\n";
+    out.write((const char *) image.data(), image.size());
+    if(!out.good())
+    {
+        if(status == STATUS_SUCCESS)
+        {
+            cerr << "Unable to write frame dump " << prefix << suffix << "!" << endl;
+        }
+        status = ERR_UNABLE_OPEN_FILE;
+        return;
+    }
+    framesWritten++;
+}
@@ -0,0 +1,104 @@
+/* Chip 8 Emulator  <chip8_display.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+
+#define FRAME_SLOT_COUNT        3           //triple buffer: one slot being written, one being read, one in between
+#define FRAME_SLOT_FRESH        0x4         //set in the shared slot index while it holds a frame the reader has not taken
+#define FRAME_DUMP_POLL_US      1000        //how long the dumper sleeps when no new frame is waiting
+
+struct CHIP8_FRAME                                      //one published display, laid out like CHIP8_EMULATOR's framebuffer
+{
+    unsigned long long frameNumber;                     //scheduler frame (60hz tick) the display was taken at
+    unsigned int version;                               //publish count, 1 for the first frame
+    unsigned int width;                                 //GFX_WIDTH or HIRES_GFX_WIDTH
+    unsigned int height;
+    unsigned int rowVersion[HIRES_GFX_HEIGHT];          //version of the frame that last changed each row
+    uint64_t rows[GFX_PLANE_COUNT][2][HIRES_GFX_HEIGHT];
+
+    uint64_t getChangedRows(unsigned int sinceVersion) const;  //bit y set when row y changed after frame sinceVersion
+};
+
+/*
+ * Lock-free triple buffer between the emulation thread (publish) and one display consumer (acquire).  Neither
+ * side ever waits: publishing swaps the finished slot with the shared one, acquiring swaps the shared slot with
+ * the one last read, each a single atomic exchange.  A reader that falls behind only sees the newest frame, and
+ * the per-row versions tell it every row that changed since the frame it read before, dropped frames included.
+ * Publishing copies only the rows that changed since the slot being written last held a frame.
+ */
+class CHIP8_TRIPLE_BUFFER
+{
+    public:
+    CHIP8_TRIPLE_BUFFER();
+
+    bool publish(CHIP8_EMULATOR &emulator, unsigned long long frameNumber); //emulation thread, false when nothing changed (no frame published)
+    const CHIP8_FRAME *acquire();                       //reader thread, the newest frame or NULL when none was published since the last call
+    unsigned long long getPublishedCount();             //emulation thread only
+    unsigned long long getDroppedCount();               //frames replaced before the reader took them (emulation thread only)
+    unsigned long long getCopiedRows();                 //row copies made by publish(), emulation thread only
+
+    private:
+    CHIP8_FRAME slots[FRAME_SLOT_COUNT];
+    alignas(64) std::atomic<unsigned int> sharedSlot;   //slot index | FRAME_SLOT_FRESH
+    alignas(64) unsigned int writeSlot;                 //owned by the emulation thread
+    unsigned int version;
+    unsigned int rowVersion[HIRES_GFX_HEIGHT];          //newest version of every row
+    unsigned int width;
+    unsigned long long published;
+    unsigned long long dropped;
+    unsigned long long copiedRows;
+    alignas(64) unsigned int readSlot;                  //owned by the reader thread
+};
+
+/*
+ * Headless frame dumper: a thread that takes frames from a CHIP8_TRIPLE_BUFFER and writes each one as a binary
+ * PPM, PREFIX_<frame number>.ppm.  It keeps the RGB image between frames and only converts the rows that changed.
+ * A frame the emulator replaces before the dumper gets to it is not written, so a slow disk costs frames, never
+ * emulation speed.
+ */
+class CHIP8_FRAME_DUMPER
+{
+    public:
+    CHIP8_FRAME_DUMPER(CHIP8_TRIPLE_BUFFER &frames, const char *prefix);
+    ~CHIP8_FRAME_DUMPER();
+
+    void start();
+    void stop();                                        //writes the last published frame if it was not yet, then joins the thread
+    unsigned long long getFramesWritten();              //after stop()
+    unsigned long long getRowsConverted();
+    int getStatus();                                    //STATUS_SUCCESS or ERR_UNABLE_OPEN_FILE after the first failed write
+
+    private:
+    void dumpLoop();
+    void dumpFrame(const CHIP8_FRAME &frame);
+
+    CHIP8_TRIPLE_BUFFER &frames;
+    std::string prefix;
+    std::thread worker;
+    std::atomic<bool> stopping;
+    std::vector<unsigned char> image;                   //RGB, width * height * 3
+    unsigned int width;
+    unsigned int lastVersion;                           //version of the last frame converted
+    unsigned long long framesWritten;
+    unsigned long long rowsConverted;
+    int status;
+};
@@ -0,0 +1,223 @@
+/* Chip 8 Emulator  <chip8_fuzz.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+/*
+ * Fuzzing entry points around CHIP8_FUZZ_TARGET.  Built with FUZZ_ENGINE=-fsanitize=fuzzer, libFuzzer (or AFL++'s
+ * libFuzzer driver) calls LLVMFuzzerTestOneInput() in a loop.  Otherwise the binary has its own main: compiled by
+ * afl-clang-fast++ it runs AFL++'s shared memory persistent loop, and run by hand it replays inputs and reports
+ * iterations per second.  The platform and quirks come from CHIP8_FUZZ_PLATFORM and CHIP8_FUZZ_QUIRKS.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include "chip8_fuzzer.h"
+#include "chip8_quirks.h"
+
+#define DEFAULT_FUZZ_REPEAT     1000            //runs of each input when replaying by hand
+
+using namespace std;
+
+#ifdef CHIP8_ENABLE_COVERAGE
+//libFuzzer picks counters in this section up next to its own, the AFL++ loop folds them into the AFL map
+static unsigned char guestEdges[FUZZ_EDGE_MAP_SIZE] __attribute__((section("__libfuzzer_extra_counters")));
+#define GUEST_EDGES guestEdges
+#else
+#define GUEST_EDGES NULL
+#endif
+
+static CHIP8_FUZZ_TARGET *target = NULL;
+
+static int createTarget(unsigned int platform, unsigned int quirks)
+{
+    const char *platformName = getenv("CHIP8_FUZZ_PLATFORM");
+    const char *quirkNames = getenv("CHIP8_FUZZ_QUIRKS");
+    if(platformName != NULL && parsePlatform(platformName, &platform) != STATUS_SUCCESS)
+    {
+        cerr << "Unknown CHIP8_FUZZ_PLATFORM " << platformName << endl;
+        return ERR_INVALID_ARGUMENT;
+    }
+    if(quirkNames != NULL && parseQuirks(quirkNames, &quirks) != STATUS_SUCCESS)
+    {
+        cerr << "Unknown CHIP8_FUZZ_QUIRKS " << quirkNames << endl;
+        return ERR_INVALID_ARGUMENT;
+    }
+    target = new CHIP8_FUZZ_TARGET(platform, quirks);
+    target->setEdgeCoverage(GUEST_EDGES);
+    return STATUS_SUCCESS;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    if(createTarget(PLATFORM_CHIP8, 0) != STATUS_SUCCESS)
+    {
+        exit(1);
+    }
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+#ifdef CHIP8_ENABLE_COVERAGE
+    memset(guestEdges, 0, sizeof(guestEdges));
+#endif
+    target->runInput(data, size);
+    return 0;   //a guest fault is an ordinary result, only the host crashing is a finding
+}
+
+#ifndef CHIP8_FUZZ_ENGINE
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+
+extern "C" unsigned char *__afl_area_ptr __attribute__((weak));
+extern "C" unsigned int __afl_map_size __attribute__((weak));
+
+static void runAFL()
+{
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+    __AFL_INIT();
+#endif
+    const unsigned char *buffer = __AFL_FUZZ_TESTCASE_BUF;
+    while(__AFL_LOOP(UINT32_MAX))
+    {
+        LLVMFuzzerTestOneInput(buffer, __AFL_FUZZ_TESTCASE_LEN);
+#ifdef CHIP8_ENABLE_COVERAGE
+        if(&__afl_area_ptr != NULL && __afl_area_ptr != NULL && &__afl_map_size != NULL)
+        {   //AFL++ only reads its own map, guest edges land in it beside the host's
+            for(unsigned int slot = 0; slot < FUZZ_EDGE_MAP_SIZE; slot++)
+            {
+                if(guestEdges[slot] != 0)
+                {
+                    __afl_area_ptr[slot % __afl_map_size] += guestEdges[slot];
+                }
+            }
+        }
+#endif
+    }
+}
+#endif
+
+static void printUsage(const char *programName)
+{
+    cerr << "Usage: " << programName << " [options] input ..." << endl
+         << "  --platform=P      chip8 (default), schip or xochip" << endl
+         << "  --quirks=Q        quirk profile or list, as for chip8_emulator" << endl
+         << "  --repeat=N        run every input N times (default " << DEFAULT_FUZZ_REPEAT << ")" << endl
+         << "  --full-reset      initEmulator() before every run instead of restoring the baseline" << endl
+         << "An input is <K> <K 16-bit little endian key masks> <ROM>." << endl;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+    if(createTarget(PLATFORM_CHIP8, 0) != STATUS_SUCCESS)
+    {
+        return ERR_INVALID_ARGUMENT;
+    }
+    runAFL();
+    return STATUS_SUCCESS;
+#endif
+    unsigned int platform = PLATFORM_CHIP8;
+    unsigned int quirks = 0;
+    unsigned long repeat = DEFAULT_FUZZ_REPEAT;
+    bool fullReset = false;
+    vector<vector<unsigned char> > inputs;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--platform=", 11) == 0)
+        {
+            if(parsePlatform(argv[i] + 11, &platform) != STATUS_SUCCESS)
+            {
+                printUsage(argv[0]);
+                return ERR_INVALID_ARGUMENT;
+            }
+        }
+        else if(strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            if(parseQuirks(argv[i] + 9, &quirks) != STATUS_SUCCESS)
+            {
+                printUsage(argv[0]);
+                return ERR_INVALID_ARGUMENT;
+            }
+        }
+        else if(strncmp(argv[i], "--repeat=", 9) == 0)
+        {
+            repeat = strtoul(argv[i] + 9, NULL, 0);
+        }
+        else if(strcmp(argv[i], "--full-reset") == 0)
+        {
+            fullReset = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            printUsage(argv[0]);
+            return ERR_INVALID_ARGUMENT;
+        }
+        else
+        {
+            ifstream file(argv[i], ios::binary);
+            if(!file)
+            {
+                cerr << "Unable to open " << argv[i] << endl;
+                return ERR_UNABLE_OPEN_FILE;
+            }
+            inputs.push_back(vector<unsigned char>(istreambuf_iterator<char>(file), istreambuf_iterator<char>()));
+        }
+    }
+    if(inputs.empty() || repeat == 0)
+    {
+        printUsage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+    }
+    if(createTarget(platform, quirks) != STATUS_SUCCESS)
+    {
+        return ERR_INVALID_ARGUMENT;
+    }
+    target->setFullReset(fullReset);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(unsigned long r = 0; r < repeat; r++)
+    {
+        for(unsigned int i = 0; i < inputs.size(); i++)
+        {
+            LLVMFuzzerTestOneInput(inputs[i].data(), inputs[i].size());
+        }
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    unsigned long runs = repeat * inputs.size();
+    cout << "Runs: " << runs << endl
+         << "Elapsed seconds: " << elapsed << endl
+         << "Runs per second: " << runs / elapsed << endl
+         << "Instructions per run: " << (double) target->getInstructionCount() / runs << endl;
+#ifdef CHIP8_ENABLE_COVERAGE
+    unsigned int edges = 0;
+    for(unsigned int slot = 0; slot < FUZZ_EDGE_MAP_SIZE; slot++)
+    {
+        edges += guestEdges[slot] != 0;
+    }
+    cout << "Guest edges (last run): " << edges << endl;
+#endif
+    delete target;
+    return STATUS_SUCCESS;
+}
+
+#endif
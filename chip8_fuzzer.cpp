@@ -0,0 +1,105 @@
+/* Chip 8 Emulator  <chip8_fuzzer.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "chip8_fuzzer.h"
+
+CHIP8_FUZZ_TARGET::CHIP8_FUZZ_TARGET(unsigned int platform, unsigned int quirks)
+{
+    this -> platform = platform;
+    this -> quirks = quirks;
+    fullReset = false;
+    instructions = 0;
+    machine = new CHIP8_EMULATOR();     //heap allocated, the decode cache is too big to keep on the stack
+    setUp();
+    machine->saveBaseline();
+}
+
+CHIP8_FUZZ_TARGET::~CHIP8_FUZZ_TARGET()
+{
+    delete machine;
+}
+
+void CHIP8_FUZZ_TARGET::setUp()
+{
+    machine->setPlatform(platform);
+    machine->setQuirks(quirks);
+    machine->seedRNG(0);    //an input must run the same every time it is replayed
+}
+
+int CHIP8_FUZZ_TARGET::runInput(const unsigned char *data, size_t size)
+{
+    if(fullReset)
+    {   //what every iteration paid before the baseline
+        machine->initEmulator();
+        setUp();
+    }
+    else
+    {
+        machine->restoreBaseline();
+    }
+
+    unsigned int scriptedFrames = 0;
+    const unsigned char *keys = data;
+    if(size > 0)
+    {
+        scriptedFrames = data[0];
+        if(1 + 2 * (size_t) scriptedFrames > size)
+        {   //fewer masks than announced, the rest of the input is the masks
+            scriptedFrames = (size - 1) / 2;
+        }
+        keys = data + 1;
+        data += 1 + 2 * scriptedFrames;
+        size -= 1 + 2 * scriptedFrames;
+    }
+    int returnValue = machine->loadROM(data, size);
+    if(returnValue != STATUS_SUCCESS)
+    {
+        return returnValue;
+    }
+
+    for(unsigned int frame = 0; frame < FUZZ_FRAME_COUNT; frame++)
+    {
+        if(frame < scriptedFrames)
+        {
+            machine->setKeyState(keys[2 * frame] | (keys[2 * frame + 1] << 8));
+        }
+        unsigned long executed = 0;
+        returnValue = machine->runInstructions(FUZZ_INSTRUCTIONS_PER_FRAME, &executed);
+        instructions += executed;
+        if(returnValue != STATUS_SUCCESS)
+        {
+            break;
+        }
+        machine->tickTimers();
+    }
+    return returnValue;
+}
+
+void CHIP8_FUZZ_TARGET::setFullReset(bool enabled)
+{
+    fullReset = enabled;
+}
+
+void CHIP8_FUZZ_TARGET::setEdgeCoverage(unsigned char *counters)
+{
+    machine->setEdgeCoverage(counters);
+}
+
+unsigned long long CHIP8_FUZZ_TARGET::getInstructionCount()
+{
+    return instructions;
+}
@@ -0,0 +1,68 @@
+/* Chip 8 Emulator  <chip8_fuzzer.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include "chip8.h"
+
+#define FUZZ_EDGE_MAP_BITS          14
+#define FUZZ_EDGE_MAP_SIZE          (1 << FUZZ_EDGE_MAP_BITS)  //guest edge counters, a hashed (from, to) pair each
+#define FUZZ_FRAME_COUNT            60          //frames an input runs for at most, one second of virtual time
+#define FUZZ_INSTRUCTIONS_PER_FRAME 10          //the emulator's default 600 Hz clock
+
+#ifdef CHIP8_ENABLE_COVERAGE                            //build with FUZZ=1, otherwise every hook compiles to nothing
+#define CHIP8_COVERAGE(from, to)    do { if(edgeCoverage != NULL) chip8CountEdge(edgeCoverage, from, to); } while(0)
+#else
+#define CHIP8_COVERAGE(from, to)    ((void)0)
+#endif
+
+inline void chip8CountEdge(unsigned char *counters, unsigned int from, unsigned int to)
+{   //Fibonacci hash of the address pair, counters stick at 255 rather than wrap back to "never taken"
+    unsigned int slot = ((((from & 0xFFFF) << 16) | (to & 0xFFFF)) * 0x9E3779B1u) >> (32 - FUZZ_EDGE_MAP_BITS);
+    if(counters[slot] != 0xFF)
+    {
+        counters[slot]++;
+    }
+}
+
+/*
+ * Persistent-mode fuzz target: one machine is set up once (platform, quirks, RNG seed 0) and saved as a baseline,
+ * and every input starts from restoreBaseline(), so an iteration only pays for the memory pages and display rows
+ * the previous one wrote.  An input is <K> <K key masks> <ROM>: byte 0 is the number of scripted frames, then
+ * one 16-bit little endian mask per frame (frame f holds keys mask f, later frames keep the last one), then the ROM
+ * bytes loaded at BASE_RAM_OFFSET.  The ROM runs for FUZZ_FRAME_COUNT frames or until an error or 00FD stops it.
+ */
+class CHIP8_FUZZ_TARGET
+{
+    public:
+    CHIP8_FUZZ_TARGET(unsigned int platform, unsigned int quirks);
+    ~CHIP8_FUZZ_TARGET();
+
+    int runInput(const unsigned char *data, size_t size);  //status that stopped the run, STATUS_SUCCESS when all frames ran
+    void setFullReset(bool enabled);                    //initEmulator() before every input instead of the baseline, for comparison
+    void setEdgeCoverage(unsigned char *counters);      //FUZZ_EDGE_MAP_SIZE counters, NULL = off (FUZZ=1 builds only)
+    unsigned long long getInstructionCount();           //over every input so far
+
+    private:
+    void setUp();                                       //platform, quirks and seed on a freshly initialized machine
+
+    CHIP8_EMULATOR *machine;
+    unsigned int platform;
+    unsigned int quirks;
+    bool fullReset;
+    unsigned long long instructions;
+};
@@ -0,0 +1,405 @@
+/* Chip 8 Emulator  <chip8_input.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <poll.h>
+#include <unistd.h>
+#include "chip8_input.h"
+
+using namespace std;
+
+static const char terminalKeys[] = "x123qweasdzc4rfv";     //terminal key for keypad key k, laid out like the VIP's 4x4 pad
+static const int terminalSignals[] = { SIGINT, SIGTERM, SIGQUIT, SIGHUP };  //kill the process while stdin is in raw mode
+
+//only one keypad can own stdin, so the copy the signal handler restores lives here
+static struct termios signalTerminal;
+static struct sigaction savedActions[sizeof(terminalSignals) / sizeof(terminalSignals[0])];
+
+static void restoreTerminalOnSignal(int signalNumber)
+{
+    //tcsetattr() and raise() are async-signal-safe, SA_RESETHAND already put back the default action
+    tcsetattr(STDIN_FILENO, TCSANOW, &signalTerminal);
+    raise(signalNumber);
+}
+
+CHIP8_KEY_QUEUE::CHIP8_KEY_QUEUE()
+{
+    head.store(0);
+    tail.store(0);
+}
+
+bool CHIP8_KEY_QUEUE::push(const KEY_EVENT &event)
+{
+    unsigned int position = head.load(memory_order_relaxed);
+    if(position - tail.load(memory_order_acquire) == KEY_QUEUE_SIZE)
+    {
+        return false;
+    }
+    events[position & (KEY_QUEUE_SIZE - 1)] = event;
+    head.store(position + 1, memory_order_release);     //the event is written before the consumer can see it
+    return true;
+}
+
+bool CHIP8_KEY_QUEUE::peek(KEY_EVENT &event)
+{
+    unsigned int position = tail.load(memory_order_relaxed);
+    if(position == head.load(memory_order_acquire))
+    {
+        return false;
+    }
+    event = events[position & (KEY_QUEUE_SIZE - 1)];
+    return true;
+}
+
+void CHIP8_KEY_QUEUE::pop()
+{
+    tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);     //hands the slot back to the producer
+}
+
+CHIP8_KEYPAD::CHIP8_KEYPAD()
+{
+    sourceType = INPUT_SOURCE_NONE;
+    fd = -1;
+    terminalSaved = false;
+    scriptNext = 0;
+    scriptQueued.store(false);
+    stopping.store(false);
+    droppedEvents.store(0);
+    frame = 0;
+    queuedKeys = 0;
+    currentKeys = 0;
+}
+
+CHIP8_KEYPAD::~CHIP8_KEYPAD()
+{
+    stop();
+}
+
+int CHIP8_KEYPAD::open(const char *source)
+{
+    if(strcmp(source, "terminal") == 0)
+    {
+        return openTerminal();
+    }
+    if(strncmp(source, "script:", 7) == 0)
+    {
+        return openScript(source + 7);
+    }
+    if(strncmp(source, "fd:", 3) == 0 && isdigit((unsigned char) source[3]))
+    {
+        return openDescriptor(atoi(source + 3));
+    }
+    return ERR_INVALID_ARGUMENT;
+}
+
+int CHIP8_KEYPAD::openTerminal()
+{
+    if(!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &savedTerminal) != 0)
+    {
+        cerr << "Keypad input needs stdin to be a terminal!" << endl;
+        return ERR_INVALID_ARGUMENT;
+    }
+    //Ctrl-C and friends still stop the emulator, the handler puts the terminal back before the default action runs
+    signalTerminal = savedTerminal;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = restoreTerminalOnSignal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for(unsigned int s = 0; s < sizeof(terminalSignals) / sizeof(terminalSignals[0]); s++)
+    {
+        sigaction(terminalSignals[s], &action, &savedActions[s]);
+    }
+    struct termios raw = savedTerminal;
+    raw.c_lflag &= ~(ICANON | ECHO);            //one key at a time, unechoed
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    terminalSaved = true;
+    fd = STDIN_FILENO;
+    sourceType = INPUT_SOURCE_TERMINAL;
+    return STATUS_SUCCESS;
+}
+
+int CHIP8_KEYPAD::openScript(const char *filename)
+{
+    ifstream in(filename);
+    if(!in.is_open())
+    {
+        cerr << "Unable to open keypad script!" << endl;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+    string line;
+    unsigned int lineNumber = 0;
+    unsigned long long lastFrame = 0;
+    script.clear();
+    while(getline(in, line))
+    {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if(comment != string::npos)
+        {
+            line.resize(comment);
+        }
+        if(line.find_first_not_of(" \t\r") == string::npos)
+        {
+            continue;
+        }
+        KEY_EVENT event;
+        if(!parseLine(line.c_str(), event) || event.frame < lastFrame)
+        {   //frames have to be in order, the queue is consumed front to back
+            cerr << "Keypad script line " << lineNumber << " is not \"<frame> <keys>\" in frame order" << endl;
+            return ERR_INVALID_ARGUMENT;
+        }
+        lastFrame = event.frame;
+        script.push_back(event);
+    }
+    scriptNext = 0;
+    sourceType = INPUT_SOURCE_SCRIPT;
+    return STATUS_SUCCESS;
+}
+
+int CHIP8_KEYPAD::openDescriptor(int fd)
+{
+    this -> fd = fd;
+    sourceType = INPUT_SOURCE_DESCRIPTOR;
+    return STATUS_SUCCESS;
+}
+
+void CHIP8_KEYPAD::start()
+{
+    if(sourceType != INPUT_SOURCE_NONE && !worker.joinable())
+    {
+        stopping.store(false);
+        while(scriptNext < script.size() && queue.push(script[scriptNext]))
+        {   //nothing else produces yet, so this is the input thread's job done early
+            scriptNext++;
+        }
+        scriptQueued.store(sourceType == INPUT_SOURCE_SCRIPT && scriptNext == script.size());
+        worker = thread(&CHIP8_KEYPAD::inputLoop, this);
+    }
+}
+
+void CHIP8_KEYPAD::stop()
+{
+    if(worker.joinable())
+    {
+        stopping.store(true);
+        worker.join();
+    }
+    if(terminalSaved)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedTerminal);
+        for(unsigned int s = 0; s < sizeof(terminalSignals) / sizeof(terminalSignals[0]); s++)
+        {
+            sigaction(terminalSignals[s], &savedActions[s], NULL);
+        }
+        terminalSaved = false;
+    }
+}
+
+bool CHIP8_KEYPAD::update(ushort *keys)
+{
+    //everything due by this frame is applied at once, keys that went down in between stay down for this frame
+    ushort seen = 0;
+    KEY_EVENT event;
+    while(true)
+    {
+        if(queue.peek(event))
+        {
+            if(event.frame > frame)
+            {
+                break;
+            }
+            queue.pop();
+            queuedKeys = event.keys;
+            seen |= event.keys;
+            continue;
+        }
+        if(sourceType != INPUT_SOURCE_SCRIPT || scriptQueued.load(memory_order_acquire))
+        {
+            break;
+        }
+        this_thread::yield();   //the script's next event may be due, it is still on its way
+    }
+    frame++;
+    ushort visible = queuedKeys | seen;
+    if(visible == currentKeys)
+    {
+        return false;
+    }
+    currentKeys = visible;
+    *keys = visible;
+    return true;
+}
+
+unsigned long long CHIP8_KEYPAD::getDroppedEvents()
+{
+    return droppedEvents.load();
+}
+
+void CHIP8_KEYPAD::inputLoop()
+{
+    switch(sourceType)
+    {
+        case INPUT_SOURCE_SCRIPT:
+            while(scriptNext < script.size() && !stopping.load())
+            {   //timed events must not be lost, wait for room instead
+                if(queue.push(script[scriptNext]))
+                {
+                    scriptNext++;
+                }
+                else
+                {
+                    this_thread::yield();
+                }
+            }
+            scriptQueued.store(true, memory_order_release);
+            break;
+
+        case INPUT_SOURCE_TERMINAL:
+            readTerminal();
+            break;
+
+        case INPUT_SOURCE_DESCRIPTOR:
+            readDescriptor();
+            break;
+    }
+}
+
+void CHIP8_KEYPAD::readTerminal()
+{
+    chrono::steady_clock::time_point releaseAt[16];
+    ushort keys = 0;
+    while(!stopping.load())
+    {
+        struct pollfd source = { fd, POLLIN, 0 };
+        if(poll(&source, 1, INPUT_POLL_MS) > 0)
+        {
+            char text[64];
+            ssize_t length = read(fd, text, sizeof(text));
+            for(ssize_t c = 0; c < length; c++)
+            {
+                const char *key = strchr(terminalKeys, tolower((unsigned char) text[c]));
+                if(key != NULL && text[c] != '\0')
+                {   //key repeat keeps pushing the release back while the key is held
+                    releaseAt[key - terminalKeys] = chrono::steady_clock::now() + chrono::milliseconds(KEY_HOLD_MS);
+                    if(!(keys & (1 << (key - terminalKeys))))
+                    {
+                        keys |= 1 << (key - terminalKeys);
+                        pushLive(keys);
+                    }
+                }
+            }
+        }
+        ushort held = 0;
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        for(unsigned int k = 0; k < 16; k++)
+        {
+            if((keys & (1 << k)) && releaseAt[k] > now)
+            {
+                held |= 1 << k;
+            }
+        }
+        if(held != keys)
+        {
+            pushLive(held);
+        }
+        keys = held;
+    }
+}
+
+void CHIP8_KEYPAD::readDescriptor()
+{
+    string pending;
+    while(!stopping.load())
+    {
+        struct pollfd source = { fd, POLLIN, 0 };
+        if(poll(&source, 1, INPUT_POLL_MS) <= 0)
+        {
+            continue;
+        }
+        char text[256];
+        ssize_t length = read(fd, text, sizeof(text));
+        if(length <= 0)
+        {   //writer closed the pipe or socket, the keypad keeps its last state
+            break;
+        }
+        pending.append(text, length);
+        size_t newline;
+        while((newline = pending.find('\n')) != string::npos)
+        {
+            KEY_EVENT event;
+            if(parseLine(pending.substr(0, newline).c_str(), event))
+            {
+                if(!queue.push(event))
+                {
+                    droppedEvents++;
+                }
+            }
+            pending.erase(0, newline + 1);
+        }
+    }
+}
+
+bool CHIP8_KEYPAD::parseLine(const char *line, KEY_EVENT &event)
+{
+    //"<frame> <keys>" or just "<keys>", numbers in C notation (0x for hex)
+    char *end;
+    unsigned long long first = strtoull(line, &end, 0);
+    if(end == line)
+    {
+        return false;
+    }
+    const char *rest = end;
+    unsigned long long second = strtoull(rest, &end, 0);
+    bool twoNumbers = end != rest;
+    while(isspace((unsigned char) *end))
+    {
+        end++;
+    }
+    if(*end != '\0')
+    {
+        return false;
+    }
+    event.frame = twoNumbers ? first : 0;
+    unsigned long long keys = twoNumbers ? second : first;
+    if(keys > 0xFFFF)
+    {
+        return false;
+    }
+    event.keys = (ushort) keys;
+    return true;
+}
+
+void CHIP8_KEYPAD::pushLive(ushort keys)
+{
+    KEY_EVENT event;
+    event.frame = 0;
+    event.keys = keys;
+    if(!queue.push(event))
+    {
+        droppedEvents++;
+    }
+}
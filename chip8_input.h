@@ -0,0 +1,103 @@
+/* Chip 8 Emulator  <chip8_input.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <termios.h>
+#include "chip8.h"
+
+#define KEY_QUEUE_SIZE          256         //events in flight between the input thread and the emulator, a power of two
+#define KEY_HOLD_MS             100         //terminals report presses only, a key counts as held this long after its last repeat
+#define INPUT_POLL_MS           10          //longest the input thread waits on its source before checking for stop()
+
+#define INPUT_SOURCE_NONE       0
+#define INPUT_SOURCE_TERMINAL   1           //stdin in raw mode, 1234/QWER/ASDF/ZXCV is the COSMAC VIP keypad
+#define INPUT_SOURCE_SCRIPT     2           //file of "<frame> <keys>" lines, applied at those frames
+#define INPUT_SOURCE_DESCRIPTOR 3           //pipe or socket carrying "[frame] <keys>" lines, a frameless line applies at the next frame
+
+struct KEY_EVENT
+{
+    unsigned long long frame;                   //earliest frame boundary the event applies at, 0 = the next one
+    ushort keys;                                //full keypad state from then on, bit k = key k down
+};
+
+/*
+ * Lock-free single producer, single consumer ring of KEY_EVENTs.  Head and tail live on their own cache lines;
+ * each side only writes its own index and publishes it with a release store, so neither ever waits on the other.
+ */
+class CHIP8_KEY_QUEUE
+{
+    public:
+    CHIP8_KEY_QUEUE();
+
+    bool push(const KEY_EVENT &event);          //producer, false when the queue is full
+    bool peek(KEY_EVENT &event);                //consumer, the oldest event without taking it
+    void pop();                                 //consumer, after a successful peek()
+
+    private:
+    KEY_EVENT events[KEY_QUEUE_SIZE];
+    alignas(64) std::atomic<unsigned int> head; //next slot the producer fills
+    alignas(64) std::atomic<unsigned int> tail; //next slot the consumer reads
+};
+
+/*
+ * The 16 key hex keypad of one machine.  An input thread reads the source and pushes keypad states into a
+ * CHIP8_KEY_QUEUE; the emulation thread calls update() once per frame, which never blocks, and hands the result
+ * to the machine (through CHIP8_RECORDER::setKeyState so recordings see it).  A key pressed and released between
+ * two frames is still held for one frame, so short taps are never lost.  A script is exact: start() queues its
+ * head before the thread runs, and should the emulator ever catch up with the thread, update() waits for it.
+ */
+class CHIP8_KEYPAD
+{
+    public:
+    CHIP8_KEYPAD();
+    ~CHIP8_KEYPAD();
+
+    int open(const char *source);               //"terminal", "script:FILE" or "fd:N"
+    int openTerminal();
+    int openScript(const char *filename);       //parsed up front, ERR_INVALID_ARGUMENT names the first bad line on stderr
+    int openDescriptor(int fd);
+    void start();                               //starts the input thread (a script's first events are queued right away)
+    void stop();                                //joins it and restores the terminal
+    bool update(ushort *keys);                  //emulation thread, once per frame: true when the keypad state changed
+    unsigned long long getDroppedEvents();      //events lost to a full queue (descriptor and terminal sources)
+    static bool parseLine(const char *line, KEY_EVENT &event);  //"[frame] <keys>", false when it is neither
+
+    private:
+    void inputLoop();
+    void readTerminal();
+    void readDescriptor();
+    void pushLive(ushort keys);                 //frameless state change, dropped (and counted) when the queue is full
+
+    unsigned int sourceType;                    //INPUT_SOURCE_*
+    int fd;
+    std::vector<KEY_EVENT> script;
+    unsigned int scriptNext;                    //next script event to queue
+    std::atomic<bool> scriptQueued;             //every script event is in the queue
+    bool terminalSaved;
+    struct termios savedTerminal;               //restored by stop(), or by the signal handler openTerminal() installs
+    std::thread worker;
+    std::atomic<bool> stopping;
+    std::atomic<unsigned long long> droppedEvents;
+    CHIP8_KEY_QUEUE queue;
+    //emulation thread only
+    unsigned long long frame;                   //update() calls so far
+    ushort queuedKeys;                          //state after the last event taken from the queue
+    ushort currentKeys;                         //state last handed to the machine
+};
@@ -0,0 +1,765 @@
+/* Chip 8 Emulator  <chip8_lockstep.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include "chip8_lockstep.h"
+#include "chip8_rom_cache.h"
+
+using namespace std;
+
+//lane masks are 0x00/0xFF bytes so every masked update is a branch-free blend the vectorizer can handle
+#define BLEND8(newValue, oldValue, m)   ((uint8_t) (((newValue) & (m)) | ((oldValue) & ~(m))))
+#define WIDEN_MASK(m)                   ((uint16_t) (int16_t) (int8_t) (m))
+#define BLEND16(newValue, oldValue, m)  ((uint16_t) (((newValue) & WIDEN_MASK(m)) | ((oldValue) & ~WIDEN_MASK(m))))
+
+CHIP8_LOCKSTEP::CHIP8_LOCKSTEP(unsigned int machineCount)
+{
+    count = machineCount;
+    registers.resize(CPU_GPR_COUNT * count);
+    pc.resize(count);
+    indexRegister.resize(count);
+    sp.resize(count);
+    stack.resize(LOCKSTEP_STACK_DEPTH * count);
+    delayTimer.resize(count);
+    soundTimer.resize(count);
+    rngState.resize(count);
+    cycles.resize(count);
+    status.resize(count);
+    frameBuffer.resize(GFX_HEIGHT * count);
+    pageTable.resize(LOCKSTEP_PAGE_COUNT * count);
+    privatePageMask.resize(count);
+    opcodes.resize(count);
+    pending.resize(count);
+    mask.resize(count);
+
+    memset(romImage, 0, MEMORY_SIZE);
+    for(unsigned int m = 0; m < count; m++)
+    {   //same default as a lone machine: seeded per machine, reproducible once seedRNG() is called
+        rngState[m] = chip8SeedToRNGState(m);
+    }
+    reset();
+}
+
+CHIP8_LOCKSTEP::~CHIP8_LOCKSTEP()
+{
+    for(unsigned int i = 0; i < privatePages.size(); i++)
+    {
+        delete[] privatePages[i];
+    }
+}
+
+void CHIP8_LOCKSTEP::reset()
+{
+    for(unsigned int i = 0; i < privatePages.size(); i++)
+    {
+        delete[] privatePages[i];
+    }
+    privatePages.clear();
+
+    fill(registers.begin(), registers.end(), 0);
+    fill(pc.begin(), pc.end(), BASE_RAM_OFFSET);
+    fill(indexRegister.begin(), indexRegister.end(), 0);
+    fill(sp.begin(), sp.end(), 0);
+    fill(stack.begin(), stack.end(), 0);
+    fill(delayTimer.begin(), delayTimer.end(), 0);
+    fill(soundTimer.begin(), soundTimer.end(), 0);
+    fill(cycles.begin(), cycles.end(), 0);
+    fill(status.begin(), status.end(), LANE_RUNNING);
+    fill(frameBuffer.begin(), frameBuffer.end(), 0);
+    fill(privatePageMask.begin(), privatePageMask.end(), 0);
+    for(unsigned int m = 0; m < count; m++)
+    {
+        for(unsigned int p = 0; p < LOCKSTEP_PAGE_COUNT; p++)
+        {
+            pageTable[m * LOCKSTEP_PAGE_COUNT + p] = &romImage[p * LOCKSTEP_PAGE_SIZE];
+        }
+    }
+    stepCount = 0;
+    waitingCount = 0;
+    groupSteps = 0;
+    scalarSteps = 0;
+}
+
+int CHIP8_LOCKSTEP::loadROM(char filename[MAX_FILENAME_LEN])
+{
+    //the same cached image a regular machine loads, so both engines start from identical memory
+    shared_ptr<const CHIP8_ROM_IMAGE> image;
+    int returnValue = CHIP8_ROM_CACHE::getInstance().getROM(filename, image);
+    if(returnValue == STATUS_SUCCESS && image->memory.getSize() != MEMORY_SIZE)
+    {   //the lanes only model the 4 KB CHIP-8 machine
+        returnValue = ERR_ROM_GREATER_THAN_RAM;
+    }
+    if(returnValue == STATUS_SUCCESS)
+    {
+        image->memory.copyTo(romImage);
+        reset();
+    }
+    return returnValue;
+}
+
+void CHIP8_LOCKSTEP::seedRNG(unsigned int machine, unsigned long long seed)
+{
+    rngState[machine] = chip8SeedToRNGState(seed);
+}
+
+unsigned int CHIP8_LOCKSTEP::getMachineCount()
+{
+    return count;
+}
+
+int CHIP8_LOCKSTEP::getStatus(unsigned int machine)
+{
+    return status[machine];
+}
+
+unsigned long CHIP8_LOCKSTEP::getCycles(unsigned int machine)
+{
+    return cycles[machine];
+}
+
+unsigned char CHIP8_LOCKSTEP::getRegister(unsigned int machine, unsigned int reg)
+{
+    return registers[reg * count + machine];
+}
+
+ushort CHIP8_LOCKSTEP::getIndexRegister(unsigned int machine)
+{
+    return indexRegister[machine];
+}
+
+ushort CHIP8_LOCKSTEP::getPC(unsigned int machine)
+{
+    return pc[machine];
+}
+
+unsigned long CHIP8_LOCKSTEP::getGroupSteps()
+{
+    return groupSteps;
+}
+
+unsigned long CHIP8_LOCKSTEP::getScalarSteps()
+{
+    return scalarSteps;
+}
+
+unsigned int CHIP8_LOCKSTEP::getPrivatePageCount()
+{
+    return privatePages.size();
+}
+
+static unsigned long long fnv1aHash(unsigned long long hash, const void *data, unsigned int length)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    for(unsigned int i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;  //64-bit FNV prime
+    }
+    return hash;
+}
+
+unsigned long long CHIP8_LOCKSTEP::getStateHash(unsigned int machine)
+{
+    //the same bytes in the same order as CHIP8_EMULATOR::getStateHash(), so lockstep and --batch results compare
+    unsigned long long hash = 0xCBF29CE484222325ULL;  //64-bit FNV offset basis
+    for(unsigned int r = 0; r < CPU_GPR_COUNT; r++)
+    {
+        hash = fnv1aHash(hash, &registers[r * count + machine], 1);
+    }
+    ushort word = indexRegister[machine];
+    hash = fnv1aHash(hash, &word, sizeof(word));
+    word = pc[machine];
+    hash = fnv1aHash(hash, &word, sizeof(word));
+    word = sp[machine];
+    hash = fnv1aHash(hash, &word, sizeof(word));
+    for(unsigned int d = 0; d < sp[machine]; d++)
+    {   //entries above the top are dead, lanes keep physical return addresses where the emulator keeps logical ones
+        word = (stack[d * count + machine] - BASE_RAM_OFFSET) & (MEMORY_SIZE - 1);
+        hash = fnv1aHash(hash, &word, sizeof(word));
+    }
+    hash = fnv1aHash(hash, &delayTimer[machine], 1);
+    hash = fnv1aHash(hash, &soundTimer[machine], 1);
+    for(unsigned int a = 0; a < MEMORY_SIZE; a++)
+    {
+        unsigned char value = readByte(machine, a);
+        hash = fnv1aHash(hash, &value, 1);
+    }
+    //the emulator's framebuffer holds every plane and hi-res half, a CHIP-8 lane only ever draws the low-res rows of plane 0
+    for(unsigned int plane = 0; plane < GFX_PLANE_COUNT; plane++)
+    {
+        for(unsigned int half = 0; half < 2; half++)
+        {
+            for(unsigned int row = 0; row < HIRES_GFX_HEIGHT; row++)
+            {
+                uint64_t bits = (plane == 0 && half == 0 && row < GFX_HEIGHT) ? frameBuffer[machine * GFX_HEIGHT + row] : 0;
+                hash = fnv1aHash(hash, &bits, sizeof(bits));
+            }
+        }
+    }
+    unsigned char display[2 + RPL_FLAG_COUNT] = { 0, 1 };  //low-res, plane 1 selected, RPL flags all 0
+    hash = fnv1aHash(hash, display, sizeof(display));
+    return hash;
+}
+
+unsigned char CHIP8_LOCKSTEP::readByte(unsigned int lane, ushort address)
+{
+    address &= (MEMORY_SIZE - 1);
+    return pageTable[lane * LOCKSTEP_PAGE_COUNT + address / LOCKSTEP_PAGE_SIZE][address % LOCKSTEP_PAGE_SIZE];
+}
+
+void CHIP8_LOCKSTEP::writeByte(unsigned int lane, ushort address, unsigned char value)
+{
+    address &= (MEMORY_SIZE - 1);
+    unsigned char *&page = pageTable[lane * LOCKSTEP_PAGE_COUNT + address / LOCKSTEP_PAGE_SIZE];
+    if(page >= romImage && page < romImage + MEMORY_SIZE)
+    {   //first write to a shared page, give this machine its own copy
+        unsigned char *copy = new unsigned char[LOCKSTEP_PAGE_SIZE];
+        memcpy(copy, page, LOCKSTEP_PAGE_SIZE);
+        privatePages.push_back(copy);
+        privatePageMask[lane] |= 1 << (address / LOCKSTEP_PAGE_SIZE);
+        page = copy;
+    }
+    page[address % LOCKSTEP_PAGE_SIZE] = value;
+}
+
+int CHIP8_LOCKSTEP::run(unsigned long steps)
+{
+    for(unsigned long s = 0; s < steps; s++)
+    {
+        if(!stepAll())
+        {
+            skipWaiting(steps - s);
+            break;
+        }
+        endStep();
+    }
+    return STATUS_SUCCESS;
+}
+
+void CHIP8_LOCKSTEP::endStep()
+{
+    //the interpreter counts every pass over FX0A as an instruction, so a waiting machine keeps pace with the step count
+    const uint8_t *laneStatus = &status[0];
+    uint64_t *laneCycles = &cycles[0];
+    if(waitingCount > 0)
+    {
+        for(unsigned int l = 0; l < count; l++)
+        {
+            laneCycles[l] += (laneStatus[l] == LANE_WAITING_FOR_KEY);
+        }
+    }
+    stepCount++;
+    if(stepCount % LOCKSTEP_FRAME_STEPS != 0)
+    {
+        return;
+    }
+    //a machine that ran this step (faulting included) has executed exactly stepCount instructions, a faulted one fewer
+    uint8_t *delay = &delayTimer[0];
+    uint8_t *sound = &soundTimer[0];
+    for(unsigned int l = 0; l < count; l++)
+    {
+        const uint8_t live = (laneCycles[l] == stepCount);
+        delay[l] -= live & (delay[l] != 0);
+        sound[l] -= live & (sound[l] != 0);
+    }
+}
+
+void CHIP8_LOCKSTEP::skipWaiting(unsigned long steps)
+{
+    //the lockstep version of the interpreter's idle loop skip: nothing changes but the cycle counts and the timers
+    const unsigned long long ticks = (stepCount + steps) / LOCKSTEP_FRAME_STEPS - stepCount / LOCKSTEP_FRAME_STEPS;
+    for(unsigned int l = 0; l < count; l++)
+    {
+        if(status[l] == LANE_WAITING_FOR_KEY)
+        {
+            cycles[l] += steps;
+            delayTimer[l] -= (delayTimer[l] < ticks) ? delayTimer[l] : ticks;
+            soundTimer[l] -= (soundTimer[l] < ticks) ? soundTimer[l] : ticks;
+        }
+    }
+    stepCount += steps;
+}
+
+bool CHIP8_LOCKSTEP::stepAll()
+{
+    uint8_t *p = &pending[0];
+    const uint8_t *laneStatus = &status[0];
+    for(unsigned int l = 0; l < count; l++)
+    {
+        p[l] = (laneStatus[l] == LANE_RUNNING) ? 0xFF : 0x00;
+    }
+    unsigned int leader = 0;
+    while(leader < count && !p[leader])
+    {
+        leader++;
+    }
+    if(leader == count)
+    {   //every machine has stopped
+        return false;
+    }
+
+    //fast path: every running machine sits on the same PC and still reads that code from the shared image
+    const uint16_t leaderPC = pc[leader];
+    const uint16_t codePages = (1 << (leaderPC / LOCKSTEP_PAGE_SIZE)) | (1 << (((leaderPC + 1) & (MEMORY_SIZE - 1)) / LOCKSTEP_PAGE_SIZE));
+    const uint16_t *lanePC = &pc[0];
+    const uint16_t *lanePrivate = &privatePageMask[0];
+    uint8_t divergent = 0;
+    for(unsigned int l = 0; l < count; l++)
+    {
+        divergent |= p[l] & ((lanePC[l] != leaderPC) | ((lanePrivate[l] & codePages) != 0));
+    }
+    if(!divergent)
+    {
+        executeGroup((romImage[leaderPC] << 8) | romImage[(leaderPC + 1) & (MEMORY_SIZE - 1)], p);
+        groupSteps++;
+        return true;
+    }
+
+    for(unsigned int lane = 0; lane < count; lane++)
+    {
+        if(p[lane])
+        {
+            opcodes[lane] = (readByte(lane, pc[lane]) << 8) | readByte(lane, pc[lane] + 1);
+        }
+    }
+
+    //lanes sharing PC and opcode run together, in the common case that is every lane in a single group
+    unsigned int groups = 0;
+    for(unsigned int lane = 0; lane < count; lane++)
+    {
+        if(!pending[lane])
+        {
+            continue;
+        }
+        if(groups == LOCKSTEP_MAX_GROUPS)
+        {   //too divergent for masking to pay off, finish the step one lane at a time
+            for(; lane < count; lane++)
+            {
+                if(pending[lane])
+                {
+                    executeLane(lane, opcodes[lane]);
+                    scalarSteps++;
+                }
+            }
+            break;
+        }
+
+        const uint16_t groupPC = pc[lane];
+        const uint16_t groupOpcode = opcodes[lane];
+        uint8_t *m = &mask[0];
+        const uint16_t *laneOpcode = &opcodes[0];
+        for(unsigned int l = 0; l < count; l++)
+        {
+            m[l] = p[l] & ((lanePC[l] == groupPC && laneOpcode[l] == groupOpcode) ? 0xFF : 0x00);
+            p[l] &= ~m[l];
+        }
+        executeGroup(groupOpcode, m);
+        groups++;
+        groupSteps++;
+    }
+    return true;
+}
+
+void CHIP8_LOCKSTEP::executeGroup(ushort opcode, const uint8_t *m)
+{
+    const unsigned int n = count;
+    const unsigned int x = (opcode & 0x0F00) >> 8;
+    const unsigned int y = (opcode & 0x00F0) >> 4;
+    const uint8_t nn = opcode & 0x00FF;
+    const uint16_t nnn = opcode & 0x0FFF;
+    uint8_t *vx = V(x);
+    uint8_t *vy = V(y);
+    uint8_t *vf = V(0xF);
+    uint16_t *lanePC = &pc[0];
+    uint16_t *laneI = &indexRegister[0];
+    uint64_t *laneCycles = &cycles[0];
+
+    switch(opcode & 0xF000)
+    {
+        case 0x1000:    //0x1NNN
+        {
+            const uint16_t target = (BASE_RAM_OFFSET + nnn) & (MEMORY_SIZE - 1);
+            for(unsigned int l = 0; l < n; l++)
+            {
+                lanePC[l] = BLEND16(target, lanePC[l], m[l]);
+            }
+            break;
+        }
+
+        case 0x3000:    //0x3XNN
+            for(unsigned int l = 0; l < n; l++)
+            {
+                lanePC[l] += m[l] & ((vx[l] == nn) ? 4 : 2);
+            }
+            break;
+
+        case 0x4000:    //0x4XNN
+            for(unsigned int l = 0; l < n; l++)
+            {
+                lanePC[l] += m[l] & ((vx[l] != nn) ? 4 : 2);
+            }
+            break;
+
+        case 0x5000:    //0x5XY0
+            for(unsigned int l = 0; l < n; l++)
+            {
+                lanePC[l] += m[l] & ((vx[l] == vy[l]) ? 4 : 2);
+            }
+            break;
+
+        case 0x9000:    //0x9XY0
+            for(unsigned int l = 0; l < n; l++)
+            {
+                lanePC[l] += m[l] & ((vx[l] != vy[l]) ? 4 : 2);
+            }
+            break;
+
+        case 0x6000:    //0x6XNN
+            for(unsigned int l = 0; l < n; l++)
+            {
+                vx[l] = BLEND8(nn, vx[l], m[l]);
+                lanePC[l] += m[l] & 2;
+            }
+            break;
+
+        case 0x7000:    //0x7XNN
+            for(unsigned int l = 0; l < n; l++)
+            {
+                vx[l] = BLEND8((uint8_t) (vx[l] + nn), vx[l], m[l]);
+                lanePC[l] += m[l] & 2;
+            }
+            break;
+
+        case 0x8000:    //0x8XY0 - 0x8XYE, same write order as the interpreter so X or Y == F behaves identically
+            switch(opcode & 0x000F)
+            {
+                case 0x0000:
+                    for(unsigned int l = 0; l < n; l++)
+                        vx[l] = BLEND8(vy[l], vx[l], m[l]);
+                    break;
+                case 0x0001:
+                    for(unsigned int l = 0; l < n; l++)
+                        vx[l] = BLEND8(vx[l] | vy[l], vx[l], m[l]);
+                    break;
+                case 0x0002:
+                    for(unsigned int l = 0; l < n; l++)
+                        vx[l] = BLEND8(vx[l] & vy[l], vx[l], m[l]);
+                    break;
+                case 0x0003:
+                    for(unsigned int l = 0; l < n; l++)
+                        vx[l] = BLEND8(vx[l] ^ vy[l], vx[l], m[l]);
+                    break;
+                case 0x0004:
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        vf[l] = BLEND8((uint8_t) ((vx[l] + vy[l]) > 255), vf[l], m[l]);
+                        vx[l] = BLEND8((uint8_t) (vx[l] + vy[l]), vx[l], m[l]);
+                    }
+                    break;
+                case 0x0005:
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        vf[l] = BLEND8((uint8_t) (vx[l] >= vy[l]), vf[l], m[l]);
+                        vx[l] = BLEND8((uint8_t) (vx[l] - vy[l]), vx[l], m[l]);
+                    }
+                    break;
+                case 0x0006:
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        vf[l] = BLEND8((uint8_t) (vx[l] & 1), vf[l], m[l]);
+                        vx[l] = BLEND8((uint8_t) (vx[l] >> 1), vx[l], m[l]);
+                    }
+                    break;
+                case 0x0007:
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        vf[l] = BLEND8((uint8_t) (vy[l] >= vx[l]), vf[l], m[l]);
+                        vx[l] = BLEND8((uint8_t) (vy[l] - vx[l]), vx[l], m[l]);
+                    }
+                    break;
+                case 0x000E:
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        vf[l] = BLEND8((uint8_t) (vx[l] >> 7), vf[l], m[l]);
+                        vx[l] = BLEND8((uint8_t) (vx[l] << 1), vx[l], m[l]);
+                    }
+                    break;
+                default:
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        if(m[l]) executeLane(l, opcode);
+                    }
+                    return;
+            }
+            for(unsigned int l = 0; l < n; l++)
+            {
+                lanePC[l] += m[l] & 2;
+            }
+            break;
+
+        case 0xA000:    //0xANNN
+            for(unsigned int l = 0; l < n; l++)
+            {
+                laneI[l] = BLEND16(nnn, laneI[l], m[l]);
+                lanePC[l] += m[l] & 2;
+            }
+            break;
+
+        case 0xB000:    //0xBNNN
+        {
+            const uint8_t *v0 = V(0);
+            for(unsigned int l = 0; l < n; l++)
+            {
+                uint16_t target = (BASE_RAM_OFFSET + ((v0[l] + nnn) & 0x0FFF)) & (MEMORY_SIZE - 1);
+                lanePC[l] = BLEND16(target, lanePC[l], m[l]);
+            }
+            break;
+        }
+
+        case 0xC000:    //0xCXNN
+        {
+            uint32_t *rng = &rngState[0];
+            for(unsigned int l = 0; l < n; l++)
+            {
+                uint32_t next = chip8StepRNG(rng[l]);
+                uint32_t wideMask = (uint32_t) (int32_t) (int8_t) m[l];
+                rng[l] = (next & wideMask) | (rng[l] & ~wideMask);
+                vx[l] = BLEND8((uint8_t) (next >> 24) & nn, vx[l], m[l]);
+                lanePC[l] += m[l] & 2;
+            }
+            break;
+        }
+
+        case 0xF000:
+            switch(opcode & 0xF0FF)
+            {
+                case 0xF007:    //0xFX07
+                {
+                    const uint8_t *delay = &delayTimer[0];
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        vx[l] = BLEND8(delay[l], vx[l], m[l]);
+                        lanePC[l] += m[l] & 2;
+                    }
+                    break;
+                }
+                case 0xF015:    //0xFX15
+                {
+                    uint8_t *delay = &delayTimer[0];
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        delay[l] = BLEND8(vx[l], delay[l], m[l]);
+                        lanePC[l] += m[l] & 2;
+                    }
+                    break;
+                }
+                case 0xF018:    //0xFX18
+                {
+                    uint8_t *sound = &soundTimer[0];
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        sound[l] = BLEND8(vx[l], sound[l], m[l]);
+                        lanePC[l] += m[l] & 2;
+                    }
+                    break;
+                }
+                case 0xF01E:    //0xFX1E
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        laneI[l] = BLEND16((uint16_t) (laneI[l] + vx[l]), laneI[l], m[l]);
+                        lanePC[l] += m[l] & 2;
+                    }
+                    break;
+                case 0xF029:    //0xFX29
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        uint16_t glyph = (BASE_FONT_OFFSET - BASE_RAM_OFFSET + (vx[l] & 0x0F) * FONT_GLYPH_SIZE) & 0x0FFF;
+                        laneI[l] = BLEND16(glyph, laneI[l], m[l]);
+                        lanePC[l] += m[l] & 2;
+                    }
+                    break;
+                default:
+                    for(unsigned int l = 0; l < n; l++)
+                    {
+                        if(m[l]) executeLane(l, opcode);
+                    }
+                    return;
+            }
+            break;
+
+        default:    //memory, stack, display and key opcodes touch per-machine memory, run them lane by lane
+            for(unsigned int l = 0; l < n; l++)
+            {
+                if(m[l]) executeLane(l, opcode);
+            }
+            return;
+    }
+
+    for(unsigned int l = 0; l < n; l++)
+    {
+        lanePC[l] &= MEMORY_SIZE - 1;                   //wrap past 0xFFE the way executeLane does, the fast path indexes romImage with it
+        laneCycles[l] += m[l] & 1;
+    }
+}
+
+void CHIP8_LOCKSTEP::executeLane(unsigned int lane, ushort opcode)
+{
+    const unsigned int n = count;
+    const unsigned int x = (opcode & 0x0F00) >> 8;
+    const unsigned int y = (opcode & 0x00F0) >> 4;
+    const uint8_t nn = opcode & 0x00FF;
+    const uint16_t nnn = opcode & 0x0FFF;
+    uint8_t &vx = registers[x * n + lane];
+    uint8_t &vy = registers[y * n + lane];
+    uint8_t &vf = registers[0xF * n + lane];
+    uint16_t &I = indexRegister[lane];
+    uint16_t nextPC = (pc[lane] + 2) & (MEMORY_SIZE - 1);
+    bool valid = true;
+
+    switch(opcode & 0xF000)
+    {
+        case 0x0000:
+            if(opcode == 0x00E0)
+            {
+                memset(&frameBuffer[lane * GFX_HEIGHT], 0, GFX_HEIGHT * sizeof(uint64_t));
+            }
+            else if(opcode == 0x00EE)
+            {
+                if(sp[lane] == 0)
+                {   //return with nothing on the stack, the PC stays on it like the interpreter's
+                    nextPC = pc[lane];
+                    valid = false;
+                    break;
+                }
+                sp[lane]--;
+                nextPC = stack[sp[lane] * n + lane];
+            }
+            else
+            {
+                valid = false;
+            }
+            break;
+
+        case 0x1000: nextPC = (BASE_RAM_OFFSET + nnn) & (MEMORY_SIZE - 1); break;
+        case 0x2000:
+            if(sp[lane] == LOCKSTEP_STACK_DEPTH)
+            {   //runaway recursion, the PC stays on the call like the interpreter's
+                nextPC = pc[lane];
+                valid = false;
+                break;
+            }
+            stack[sp[lane] * n + lane] = nextPC;
+            sp[lane]++;
+            nextPC = (BASE_RAM_OFFSET + nnn) & (MEMORY_SIZE - 1);
+            break;
+        case 0x3000: if(vx == nn) nextPC += 2; break;
+        case 0x4000: if(vx != nn) nextPC += 2; break;
+        case 0x5000: if(vx == vy) nextPC += 2; break;
+        case 0x6000: vx = nn; break;
+        case 0x7000: vx += nn; break;
+        case 0x8000:
+            switch(opcode & 0x000F)
+            {
+                case 0x0000: vx = vy; break;
+                case 0x0001: vx |= vy; break;
+                case 0x0002: vx &= vy; break;
+                case 0x0003: vx ^= vy; break;
+                case 0x0004: vf = (vx + vy) > 255; vx += vy; break;
+                case 0x0005: vf = vx >= vy; vx -= vy; break;
+                case 0x0006: vf = vx & 1; vx >>= 1; break;
+                case 0x0007: vf = vy >= vx; vx = vy - vx; break;
+                case 0x000E: vf = vx >> 7; vx <<= 1; break;
+                default: valid = false;
+            }
+            break;
+        case 0x9000: if(vx != vy) nextPC += 2; break;
+        case 0xA000: I = nnn; break;
+        case 0xB000: nextPC = (BASE_RAM_OFFSET + ((registers[lane] + nnn) & 0x0FFF)) & (MEMORY_SIZE - 1); break;
+        case 0xC000:
+            rngState[lane] = chip8StepRNG(rngState[lane]);
+            vx = (uint8_t) (rngState[lane] >> 24) & nn;
+            break;
+        case 0xD000:
+        {
+            unsigned int column = vx & (GFX_WIDTH - 1);
+            unsigned int row = vy & (GFX_HEIGHT - 1);
+            unsigned int rows = opcode & 0x000F;
+            if(row + rows > GFX_HEIGHT)
+            {
+                rows = GFX_HEIGHT - row;
+            }
+            uint64_t *screen = &frameBuffer[lane * GFX_HEIGHT + row];
+            uint64_t collision = 0;
+            for(unsigned int r = 0; r < rows; r++)
+            {
+                uint64_t sprite = ((uint64_t) readByte(lane, BASE_RAM_OFFSET + I + r) << (GFX_WIDTH - 8)) >> column;
+                collision |= screen[r] & sprite;
+                screen[r] ^= sprite;
+            }
+            vf = collision != 0;
+            break;
+        }
+        case 0xE000:
+            //lanes have no keypad, every key reads as released: EX9E never skips and EXA1 always does
+            valid = ((opcode & 0xF0FF) == 0xE09E) || ((opcode & 0xF0FF) == 0xE0A1);
+            if((opcode & 0xF0FF) == 0xE0A1)
+            {
+                nextPC += 2;
+            }
+            break;
+        case 0xF000:
+            switch(opcode & 0xF0FF)
+            {
+                case 0xF007: vx = delayTimer[lane]; break;
+                case 0xF00A:
+                    //nothing can feed a key to a lane, park it on the instruction, endStep() counts this and every later pass
+                    status[lane] = LANE_WAITING_FOR_KEY;
+                    waitingCount++;
+                    return;
+                case 0xF015: delayTimer[lane] = vx; break;
+                case 0xF018: soundTimer[lane] = vx; break;
+                case 0xF01E: I += vx; break;
+                case 0xF029: I = (BASE_FONT_OFFSET - BASE_RAM_OFFSET + (vx & 0x0F) * FONT_GLYPH_SIZE) & 0x0FFF; break;
+                case 0xF033:
+                    writeByte(lane, BASE_RAM_OFFSET + I, vx / 100);
+                    writeByte(lane, BASE_RAM_OFFSET + I + 1, (vx / 10) % 10);
+                    writeByte(lane, BASE_RAM_OFFSET + I + 2, vx % 10);
+                    break;
+                case 0xF055:
+                    for(unsigned int i = 0; i <= x; i++)
+                    {
+                        writeByte(lane, BASE_RAM_OFFSET + I + i, registers[i * n + lane]);
+                    }
+                    break;
+                case 0xF065:
+                    for(unsigned int i = 0; i <= x; i++)
+                    {
+                        registers[i * n + lane] = readByte(lane, BASE_RAM_OFFSET + I + i);
+                    }
+                    break;
+                default: valid = false;
+            }
+            break;
+    }
+
+    pc[lane] = nextPC & (MEMORY_SIZE - 1);
+    cycles[lane]++;
+    if(!valid)
+    {
+        status[lane] = LANE_FAULTED;
+    }
+}
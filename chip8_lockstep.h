@@ -0,0 +1,99 @@
+/* Chip 8 Emulator  <chip8_lockstep.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+#include "chip8_scheduler.h"
+
+#define LOCKSTEP_PAGE_SIZE          256
+#define LOCKSTEP_PAGE_COUNT         (MEMORY_SIZE / LOCKSTEP_PAGE_SIZE)
+#define LOCKSTEP_STACK_DEPTH        STACK_DEPTH
+#define LOCKSTEP_MAX_GROUPS         8           //distinct (PC, opcode) groups run masked per step before the rest go scalar
+#define LOCKSTEP_FRAME_STEPS        (DEFAULT_CPU_CLOCK / TIMER_FREQUENCY)  //steps per 60hz timer tick, CHIP8_SCHEDULER's default frame
+
+#define LANE_RUNNING                0
+#define LANE_FAULTED                1           //invalid opcode or stack over/underflow
+#define LANE_WAITING_FOR_KEY        2           //spinning on FX0A, still counts cycles and ticks its timers
+
+/*
+ * Runs many CHIP-8 machines in lockstep.  Every piece of machine state is stored structure-of-arrays
+ * (one array per register, indexed by machine) so that an instruction shared by a group of machines
+ * runs as one loop over contiguous lanes, which the compiler turns into SSE2/AVX2/AVX-512 code.
+ * Memory is paged: every machine starts out pointing at the pages of one shared ROM image and
+ * only gets a private copy of a page when it writes to it.  The timers tick every LOCKSTEP_FRAME_STEPS steps, at the
+ * same instruction counts CHIP8_SCHEDULER ticks them at, so a machine ends where a batch or headless run does.
+ */
+class CHIP8_LOCKSTEP
+{
+    public:
+    CHIP8_LOCKSTEP(unsigned int machineCount);
+    ~CHIP8_LOCKSTEP();
+
+    int loadROM(char filename[MAX_FILENAME_LEN]);       //loads one ROM image shared by every machine and resets them all
+    void seedRNG(unsigned int machine, unsigned long long seed);
+    int run(unsigned long steps);                       //steps every running machine up to steps times
+    unsigned int getMachineCount();
+    int getStatus(unsigned int machine);
+    unsigned long getCycles(unsigned int machine);      //instructions executed by that machine
+    unsigned char getRegister(unsigned int machine, unsigned int reg);
+    ushort getIndexRegister(unsigned int machine);
+    ushort getPC(unsigned int machine);                 //physical address of the next instruction
+    unsigned long long getStateHash(unsigned int machine);
+    unsigned long getGroupSteps();                      //instructions run as one masked vector operation
+    unsigned long getScalarSteps();                     //instructions run one machine at a time
+    unsigned int getPrivatePageCount();                 //pages copied on write so far
+
+    private:
+    void reset();
+    bool stepAll();                                     //one instruction for every running machine, false when none runs
+    void endStep();                                     //counts the step for machines waiting on FX0A, ticks the timers at a frame end
+    void skipWaiting(unsigned long steps);              //no machine runs: the waiting ones spin through steps at once
+    void executeGroup(ushort opcode, const uint8_t *mask);  //opcode for every lane whose mask byte is 0xFF
+    void executeLane(unsigned int lane, ushort opcode);     //opcode for a single lane (reference semantics)
+    unsigned char readByte(unsigned int lane, ushort address);
+    void writeByte(unsigned int lane, ushort address, unsigned char value);  //copies the page on first write
+    uint8_t *V(unsigned int reg) { return &registers[reg * count]; }
+
+    unsigned int count;
+    std::vector<uint8_t> registers;                     //V0-VF, register r of machine m at [r * count + m]
+    std::vector<uint16_t> pc;
+    std::vector<uint16_t> indexRegister;
+    std::vector<uint8_t> sp;
+    std::vector<uint16_t> stack;                        //entry d of machine m at [d * count + m]
+    std::vector<uint8_t> delayTimer;
+    std::vector<uint8_t> soundTimer;
+    std::vector<uint32_t> rngState;
+    std::vector<uint64_t> cycles;
+    std::vector<uint8_t> status;
+    std::vector<uint64_t> frameBuffer;                  //GFX_HEIGHT rows per machine, machine m at [m * GFX_HEIGHT]
+
+    unsigned char romImage[MEMORY_SIZE];                //shared copy-on-write image every machine starts from
+    std::vector<unsigned char*> pageTable;              //page p of machine m at [m * LOCKSTEP_PAGE_COUNT + p]
+    std::vector<unsigned char*> privatePages;           //pages copied on write, freed on reset
+    std::vector<uint16_t> privatePageMask;              //bit p set once the machine has its own copy of page p
+
+    std::vector<uint16_t> opcodes;                      //scratch: opcode fetched by each lane this step
+    std::vector<uint8_t> pending;                       //scratch: 0xFF while a lane still has to run this step
+    std::vector<uint8_t> mask;                          //scratch: lanes in the group being executed
+
+    unsigned long long stepCount;                       //steps since reset(), frames end at multiples of LOCKSTEP_FRAME_STEPS
+    unsigned int waitingCount;                          //machines parked on FX0A
+    unsigned long groupSteps;
+    unsigned long scalarSteps;
+};
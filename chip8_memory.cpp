@@ -0,0 +1,283 @@
+/* Chip 8 Emulator  <chip8_memory.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include "chip8_memory.h"
+
+using namespace std;
+
+static const shared_ptr<MEMORY_PAGE>& zeroPage()
+{   //one all-zero page referenced by every fresh address space
+    static const shared_ptr<MEMORY_PAGE> page(new MEMORY_PAGE());
+    return page;
+}
+
+CHIP8_MEMORY::CHIP8_MEMORY()
+{
+    pages = inlinePages;
+    pageData = inlinePageData;
+    writtenPages = inlineWrittenPages;
+    heapTable = NULL;
+    pageCount = MEMORY_PAGE_COUNT;
+    addressMask = MEMORY_SIZE - 1;
+    clear();
+}
+
+CHIP8_MEMORY::CHIP8_MEMORY(const CHIP8_MEMORY &other)
+{
+    pages = inlinePages;
+    pageData = inlinePageData;
+    writtenPages = inlineWrittenPages;
+    heapTable = NULL;
+    pageCount = 0;
+    sharePagesOf(other);
+}
+
+CHIP8_MEMORY& CHIP8_MEMORY::operator=(const CHIP8_MEMORY &other)
+{
+    if(this != &other)
+    {
+        sharePagesOf(other);
+    }
+    return *this;
+}
+
+CHIP8_MEMORY::~CHIP8_MEMORY()
+{
+    delete heapTable;
+}
+
+void CHIP8_MEMORY::setTableSize(unsigned int newPageCount)
+{
+    if(newPageCount > MEMORY_PAGE_COUNT && heapTable == NULL)
+    {
+        heapTable = new MEMORY_PAGE_TABLE();
+        for(unsigned int p = 0; p < pageCount; p++)
+        {
+            heapTable->pages[p] = std::move(inlinePages[p]);
+            heapTable->pageData[p] = inlinePageData[p];
+        }
+        memcpy(heapTable->writtenPages, inlineWrittenPages, sizeof(inlineWrittenPages));
+        pages = heapTable->pages;
+        pageData = heapTable->pageData;
+        writtenPages = heapTable->writtenPages;
+    }
+    else if(newPageCount <= MEMORY_PAGE_COUNT && heapTable != NULL)
+    {   //back inside the object, pages past the new end are released with the heap table
+        for(unsigned int p = 0; p < newPageCount && p < pageCount; p++)
+        {
+            inlinePages[p] = std::move(heapTable->pages[p]);
+            inlinePageData[p] = heapTable->pageData[p];
+        }
+        memcpy(inlineWrittenPages, heapTable->writtenPages, sizeof(inlineWrittenPages));
+        delete heapTable;
+        heapTable = NULL;
+        pages = inlinePages;
+        pageData = inlinePageData;
+        writtenPages = inlineWrittenPages;
+    }
+}
+
+unsigned int CHIP8_MEMORY::getWrittenWordCount() const
+{
+    return (heapTable != NULL) ? MAX_MEMORY_PAGE_COUNT / 64 : (MEMORY_PAGE_COUNT + 63) / 64;
+}
+
+void CHIP8_MEMORY::sharePagesOf(const CHIP8_MEMORY &other)
+{
+    if(other.pageCount <= MEMORY_PAGE_COUNT && pageCount > other.pageCount)
+    {   //the table is about to move inside the object, only other's pages need to survive it
+        pageCount = other.pageCount;
+    }
+    setTableSize(other.pageCount);
+    for(unsigned int p = 0; p < other.pageCount; p++)
+    {
+        pages[p] = other.pages[p];
+        pageData[p] = other.pageData[p];
+    }
+    for(unsigned int p = other.pageCount; p < pageCount; p++)
+    {   //a smaller address space than before, release the rest
+        pages[p].reset();
+        pageData[p] = NULL;
+    }
+    pageCount = other.pageCount;
+    addressMask = other.addressMask;
+    zobristHash = other.zobristHash;
+    memset(writtenPages, 0xFF, getWrittenWordCount() * sizeof(writtenPages[0]));    //every page may hold something else now
+}
+
+void CHIP8_MEMORY::clear()
+{
+    for(unsigned int p = 0; p < pageCount; p++)
+    {
+        pages[p] = zeroPage();
+        pageData[p] = pages[p]->bytes;
+    }
+    zobristHash = 0;
+    memset(writtenPages, 0xFF, getWrittenWordCount() * sizeof(writtenPages[0]));
+}
+
+void CHIP8_MEMORY::resize(unsigned int size)
+{
+    unsigned int newPageCount = size / MEMORY_PAGE_SIZE;
+    for(unsigned int p = newPageCount; p < pageCount; p++)
+    {
+        zobristHash ^= hashPage(p);
+    }
+    setTableSize(newPageCount);
+    for(unsigned int p = pageCount; p < newPageCount; p++)
+    {
+        pages[p] = zeroPage();
+        pageData[p] = pages[p]->bytes;
+    }
+    for(unsigned int p = newPageCount; p < pageCount && heapTable != NULL; p++)
+    {   //still on the heap table, shrinking within it
+        pages[p].reset();
+        pageData[p] = NULL;
+    }
+    pageCount = newPageCount;
+    addressMask = size - 1;
+    memset(writtenPages, 0xFF, getWrittenWordCount() * sizeof(writtenPages[0]));
+}
+
+unsigned int CHIP8_MEMORY::getSize() const
+{
+    return pageCount * MEMORY_PAGE_SIZE;
+}
+
+unsigned int CHIP8_MEMORY::getPageCount() const
+{
+    return pageCount;
+}
+
+void CHIP8_MEMORY::makePagePrivate(unsigned int page)
+{
+    //use_count() can only overestimate here (another owner dropping its reference concurrently), which just costs a spare copy
+    if(pages[page].use_count() > 1)
+    {
+        shared_ptr<MEMORY_PAGE> copy(new MEMORY_PAGE(*pages[page]));
+        pages[page] = copy;
+        pageData[page] = copy->bytes;
+    }
+}
+
+void CHIP8_MEMORY::write(ushort address, unsigned char value)
+{
+    address &= addressMask;
+    makePagePrivate(address / MEMORY_PAGE_SIZE);
+    markPageWritten(address / MEMORY_PAGE_SIZE);
+    unsigned char &byte = pageData[address / MEMORY_PAGE_SIZE][address % MEMORY_PAGE_SIZE];
+    zobristHash ^= zobristByteKey(address, byte) ^ zobristByteKey(address, value);
+    byte = value;
+}
+
+void CHIP8_MEMORY::load(ushort address, const unsigned char *data, unsigned int length)
+{
+    while(length > 0)
+    {
+        address &= addressMask;
+        unsigned int page = address / MEMORY_PAGE_SIZE;
+        unsigned int offset = address % MEMORY_PAGE_SIZE;
+        unsigned int chunk = MEMORY_PAGE_SIZE - offset;
+        if(chunk > length)
+        {
+            chunk = length;
+        }
+        makePagePrivate(page);
+        markPageWritten(page);
+        for(unsigned int i = 0; i < chunk; i++)
+        {
+            zobristHash ^= zobristByteKey(address + i, pageData[page][offset + i]) ^ zobristByteKey(address + i, data[i]);
+        }
+        memcpy(&pageData[page][offset], data, chunk);
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void CHIP8_MEMORY::copyTo(unsigned char *out) const
+{
+    for(unsigned int p = 0; p < pageCount; p++)
+    {
+        memcpy(&out[p * MEMORY_PAGE_SIZE], pageData[p], MEMORY_PAGE_SIZE);
+    }
+}
+
+bool CHIP8_MEMORY::equals(const CHIP8_MEMORY &other) const
+{
+    if(pageCount != other.pageCount)
+    {
+        return false;
+    }
+    for(unsigned int p = 0; p < pageCount; p++)
+    {
+        if(pageData[p] != other.pageData[p] && memcmp(pageData[p], other.pageData[p], MEMORY_PAGE_SIZE) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const unsigned char* CHIP8_MEMORY::getPage(unsigned int page) const
+{
+    return pageData[page];
+}
+
+bool CHIP8_MEMORY::isPageShared(unsigned int page) const
+{
+    return pages[page].use_count() > 1;
+}
+
+bool CHIP8_MEMORY::isPageWritten(unsigned int page) const
+{
+    return (writtenPages[page / 64] >> (page % 64)) & 1;
+}
+
+void CHIP8_MEMORY::markPagesClean()
+{
+    memset(writtenPages, 0, getWrittenWordCount() * sizeof(writtenPages[0]));
+}
+
+void CHIP8_MEMORY::restorePage(unsigned int page, const CHIP8_MEMORY &from)
+{
+    if(pages[page] != from.pages[page])
+    {
+        zobristHash ^= hashPage(page) ^ from.hashPage(page);
+        if(pages[page].use_count() == 1)
+        {   //already private, copying the bytes back keeps it so and the next write needs no fresh page
+            memcpy(pageData[page], from.pageData[page], MEMORY_PAGE_SIZE);
+        }
+        else
+        {
+            pages[page] = from.pages[page];
+            pageData[page] = from.pageData[page];
+        }
+    }
+    writtenPages[page / 64] &= ~(1ULL << (page % 64));
+}
+
+unsigned long long CHIP8_MEMORY::hashPage(unsigned int page) const
+{
+    unsigned long long hash = 0;
+    for(unsigned int offset = 0; offset < MEMORY_PAGE_SIZE; offset++)
+    {
+        hash ^= zobristByteKey(page * MEMORY_PAGE_SIZE + offset, pageData[page][offset]);
+    }
+    return hash;
+}
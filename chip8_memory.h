@@ -0,0 +1,115 @@
+/* Chip 8 Emulator  <chip8_memory.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <memory>
+
+#define MEMORY_SIZE         4096        //chip 8 vm only has 4k (SUPER-CHIP too)
+#define XO_MEMORY_SIZE      65536       //XO-CHIP, the largest address space a CHIP8_MEMORY holds
+#define MEMORY_PAGE_SIZE    256
+#define MEMORY_PAGE_COUNT   (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+#define MAX_MEMORY_PAGE_COUNT   (XO_MEMORY_SIZE / MEMORY_PAGE_SIZE)
+
+typedef unsigned short int ushort;
+
+inline unsigned long long zobristMix(unsigned long long x)
+{   //splitmix64 finalizer, stands in for a table of random Zobrist keys
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+inline unsigned long long zobristByteKey(unsigned int address, unsigned char value)
+{   //a zero byte contributes nothing, so zeroed memory hashes to 0 whatever its size
+    return value != 0 ? zobristMix(((unsigned long long) address << 8) | value) : 0;
+}
+
+struct MEMORY_PAGE
+{
+    unsigned char bytes[MEMORY_PAGE_SIZE];
+};
+
+struct MEMORY_PAGE_TABLE                                //page references of an address space larger than MEMORY_SIZE
+{
+    std::shared_ptr<MEMORY_PAGE> pages[MAX_MEMORY_PAGE_COUNT];
+    unsigned char *pageData[MAX_MEMORY_PAGE_COUNT];
+    unsigned long long writtenPages[MAX_MEMORY_PAGE_COUNT / 64];
+};
+
+/*
+ * Paged copy-on-write address space.  Copying a CHIP8_MEMORY only copies page references, the
+ * 256 byte pages themselves are shared until one of the owners writes to them.  Reads go through
+ * a raw pointer per page so they cost the same as indexing a flat array.  The size is MEMORY_SIZE unless
+ * resize() changes it, addresses wrap at the size and only that many pages are referenced or copied.  The page
+ * table of a MEMORY_SIZE space lives inside the object, so a classic machine stays small to fork; only a resize past
+ * it moves the table to the heap.
+ */
+class CHIP8_MEMORY
+{
+    public:
+    CHIP8_MEMORY();                                     //MEMORY_SIZE bytes, every page starts as the shared zero page
+    CHIP8_MEMORY(const CHIP8_MEMORY &other);            //shares all of other's pages
+    CHIP8_MEMORY& operator=(const CHIP8_MEMORY &other);
+    ~CHIP8_MEMORY();
+
+    unsigned char read(ushort address) const
+    {
+        address &= addressMask;
+        return pageData[address / MEMORY_PAGE_SIZE][address % MEMORY_PAGE_SIZE];
+    }
+    void write(ushort address, unsigned char value);    //copies the page first if anyone else still references it
+    void clear();                                       //drops every page back to the shared zero page
+    void resize(unsigned int size);                     //MEMORY_SIZE or XO_MEMORY_SIZE, added pages are zero, pages past the end are dropped
+    unsigned int getSize() const;
+    unsigned int getPageCount() const;
+    void load(ushort address, const unsigned char *data, unsigned int length);  //bulk write (e.g. ROM or font)
+    void copyTo(unsigned char *out) const;              //getSize() bytes
+    bool equals(const CHIP8_MEMORY &other) const;       //same size and contents
+    const unsigned char* getPage(unsigned int page) const;  //raw bytes of one page, for serialization
+    bool isPageShared(unsigned int page) const;         //true while another machine references the same page
+    unsigned long long getZobristHash() const           //XOR of zobristByteKey() over every byte, kept up to date by each write
+    {
+        return zobristHash;
+    }
+    bool isPageWritten(unsigned int page) const;        //written (or replaced) since the last markPagesClean()
+    void markPagesClean();
+    void restorePage(unsigned int page, const CHIP8_MEMORY &from);  //page gets from's bytes back and is clean again
+
+    private:
+    void makePagePrivate(unsigned int page);
+    unsigned long long hashPage(unsigned int page) const;   //the page's share of zobristHash
+    void sharePagesOf(const CHIP8_MEMORY &other);
+    void setTableSize(unsigned int newPageCount);       //moves the table between the object and the heap, keeping the first pages
+    unsigned int getWrittenWordCount() const;           //words in writtenPages
+    void markPageWritten(unsigned int page)
+    {
+        writtenPages[page / 64] |= 1ULL << (page % 64);
+    }
+
+    std::shared_ptr<MEMORY_PAGE> *pages;                //only the first pageCount are set, inlinePages or heapTable->pages
+    unsigned char **pageData;                           //pages[p]->bytes, cached for the read path
+    unsigned long long *writtenPages;                   //bit per page, so a reset only has to restore those
+    unsigned int pageCount;
+    ushort addressMask;                                 //size - 1
+    unsigned long long zobristHash;
+    MEMORY_PAGE_TABLE *heapTable;                       //NULL while the space fits MEMORY_PAGE_COUNT pages
+    std::shared_ptr<MEMORY_PAGE> inlinePages[MEMORY_PAGE_COUNT];
+    unsigned char *inlinePageData[MEMORY_PAGE_COUNT];
+    unsigned long long inlineWrittenPages[(MEMORY_PAGE_COUNT + 63) / 64];
+};
@@ -0,0 +1,233 @@
+/* Chip 8 Emulator  <chip8_profile.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "chip8_profile.h"
+
+#define PROFILE_MAX_DEPTH       64          //deeper calls are charged to the deepest tracked routine (runaway recursion, 2NNN used as a jump)
+
+using namespace std;
+
+static const char *familyNames[PROFILE_FAMILY_COUNT] =
+{
+    "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XY_", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX__", "FX__"
+};
+
+static const char *skipNames[PROFILE_SKIP_COUNT] = { "3XNN", "4XNN", "5XY0", "9XY0", "EX9E", "EXA1" };
+
+CHIP8_PROFILER::CHIP8_PROFILER(unsigned int samplePeriod)
+{
+    this -> samplePeriod = 1;
+    setSamplePeriod(samplePeriod);
+    reset();
+}
+
+void CHIP8_PROFILER::reset()
+{
+    sampleCountdown = samplePeriod;
+    for(unsigned int f = 0; f < PROFILE_FAMILY_COUNT; f++)
+    {
+        familyCounts[f] = 0;
+    }
+    heatmap.assign(XO_MEMORY_SIZE, 0);
+    for(unsigned int s = 0; s < PROFILE_SKIP_COUNT; s++)
+    {
+        skipCounts[s][0] = 0;
+        skipCounts[s][1] = 0;
+    }
+    skipSiteCounts[0].assign(XO_MEMORY_SIZE, 0);
+    skipSiteCounts[1].assign(XO_MEMORY_SIZE, 0);
+
+    nodes.clear();
+    nodes.resize(1);
+    nodes[0].routine = BASE_RAM_OFFSET;
+    nodes[0].parent = 0;
+    nodes[0].samples = 0;
+    currentNode = 0;
+    depth = 0;
+    maxDepth = 0;
+    calls = 0;
+    returns = 0;
+    unbalancedReturns = 0;
+}
+
+void CHIP8_PROFILER::setSamplePeriod(unsigned int period)
+{
+    samplePeriod = (period == 0) ? 1 : period;
+    sampleCountdown = samplePeriod;
+}
+
+void CHIP8_PROFILER::onSkip(unsigned int skipType, unsigned int address, bool taken)
+{
+    skipCounts[skipType][taken]++;
+    skipSiteCounts[taken][address & (XO_MEMORY_SIZE - 1)]++;
+}
+
+void CHIP8_PROFILER::onCall(unsigned int target)
+{
+    calls++;
+    depth++;
+    if(depth > maxDepth)
+    {
+        maxDepth = depth;
+    }
+    if(depth > PROFILE_MAX_DEPTH)
+    {
+        return;
+    }
+    ushort routine = target & (XO_MEMORY_SIZE - 1);
+    map<ushort, unsigned int>::iterator child = nodes[currentNode].children.find(routine);
+    if(child != nodes[currentNode].children.end())
+    {
+        currentNode = child->second;
+        return;
+    }
+    PROFILE_NODE node;
+    node.routine = routine;
+    node.parent = currentNode;
+    node.samples = 0;
+    nodes.push_back(node);
+    nodes[currentNode].children[routine] = nodes.size() - 1;
+    currentNode = nodes.size() - 1;
+}
+
+void CHIP8_PROFILER::onReturn()
+{
+    returns++;
+    if(depth == 0)
+    {   //returning from a call made before profiling started, keep charging the root
+        unbalancedReturns++;
+        return;
+    }
+    if(depth <= PROFILE_MAX_DEPTH)
+    {
+        currentNode = nodes[currentNode].parent;
+    }
+    depth--;
+}
+
+int CHIP8_PROFILER::writeJSON(const char *filename)
+{
+    ofstream out(filename, ios::trunc);
+    if(!out.is_open())
+    {
+        cerr << "Unable to open profile output file!" << endl;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+
+    unsigned long long instructions = 0;
+    for(unsigned int f = 0; f < PROFILE_FAMILY_COUNT; f++)
+    {
+        instructions += familyCounts[f];
+    }
+    out << "{" << endl;
+    out << "  \"sample_period\": " << samplePeriod << "," << endl;
+    out << "  \"instructions\": " << instructions << "," << endl;
+
+    out << "  \"families\": {";
+    for(unsigned int f = 0; f < PROFILE_FAMILY_COUNT; f++)
+    {
+        out << (f ? ", " : "") << "\"" << familyNames[f] << "\": " << familyCounts[f];
+    }
+    out << "}," << endl;
+
+    out << "  \"skips\": {";
+    for(unsigned int s = 0; s < PROFILE_SKIP_COUNT; s++)
+    {
+        out << (s ? ", " : "") << "\"" << skipNames[s] << "\": {\"taken\": " << skipCounts[s][1]
+            << ", \"not_taken\": " << skipCounts[s][0] << "}";
+    }
+    out << "}," << endl;
+
+    out << "  \"skip_sites\": [";
+    bool first = true;
+    for(unsigned int address = 0; address < XO_MEMORY_SIZE; address++)
+    {
+        if(skipSiteCounts[0][address] + skipSiteCounts[1][address] > 0)
+        {
+            out << (first ? "" : ",") << endl << "    {\"address\": " << address << ", \"taken\": " << skipSiteCounts[1][address]
+                << ", \"not_taken\": " << skipSiteCounts[0][address] << "}";
+            first = false;
+        }
+    }
+    out << endl << "  ]," << endl;
+
+    out << "  \"calls\": {\"calls\": " << calls << ", \"returns\": " << returns << ", \"max_depth\": " << maxDepth
+        << ", \"unbalanced_returns\": " << unbalancedReturns << "}," << endl;
+
+    //self samples per routine, whatever stack it was called from
+    map<ushort, unsigned long long> routineSamples;
+    for(unsigned int n = 0; n < nodes.size(); n++)
+    {
+        routineSamples[nodes[n].routine] += nodes[n].samples;
+    }
+    out << "  \"routines\": [";
+    first = true;
+    for(map<ushort, unsigned long long>::iterator routine = routineSamples.begin(); routine != routineSamples.end(); ++routine)
+    {
+        out << (first ? "" : ",") << endl << "    {\"address\": " << routine->first << ", \"self\": " << routine->second << "}";
+        first = false;
+    }
+    out << endl << "  ]," << endl;
+
+    out << "  \"heatmap\": [";
+    first = true;
+    for(unsigned int address = 0; address < XO_MEMORY_SIZE; address++)
+    {
+        if(heatmap[address] > 0)
+        {
+            out << (first ? "" : ",") << endl << "    {\"address\": " << address << ", \"count\": " << heatmap[address] << "}";
+            first = false;
+        }
+    }
+    out << endl << "  ]" << endl;
+    out << "}" << endl;
+    return out.fail() ? ERR_UNABLE_OPEN_FILE : STATUS_SUCCESS;
+}
+
+int CHIP8_PROFILER::writeFolded(const char *filename)
+{
+    ofstream out(filename, ios::trunc);
+    if(!out.is_open())
+    {
+        cerr << "Unable to open profile output file!" << endl;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+    string path = "main";
+    writeFoldedNode(out, 0, path);
+    return out.fail() ? ERR_UNABLE_OPEN_FILE : STATUS_SUCCESS;
+}
+
+void CHIP8_PROFILER::writeFoldedNode(ostream &out, unsigned int node, string &path)
+{
+    if(nodes[node].samples > 0)
+    {
+        out << path << ' ' << nodes[node].samples << endl;
+    }
+    for(map<ushort, unsigned int>::iterator child = nodes[node].children.begin(); child != nodes[node].children.end(); ++child)
+    {   //depth is bounded by PROFILE_MAX_DEPTH, so plain recursion is fine
+        size_t length = path.size();
+        char frame[16];
+        snprintf(frame, sizeof(frame), ";sub_0x%03x", child->first);
+        path += frame;
+        writeFoldedNode(out, child->second, path);
+        path.resize(length);
+    }
+}
@@ -0,0 +1,96 @@
+/* Chip 8 Emulator  <chip8_profile.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+#ifdef CHIP8_ENABLE_PROFILE                             //build with PROFILE=1, otherwise every hook compiles to nothing
+#define CHIP8_PROFILE(call)     do { if(profiler != NULL) profiler->call; } while(0)
+#else
+#define CHIP8_PROFILE(call)     ((void)0)
+#endif
+
+#define PROFILE_FAMILY_COUNT    16                      //opcode families, one per leading hex digit
+#define PROFILE_SKIP_3XNN       0
+#define PROFILE_SKIP_4XNN       1
+#define PROFILE_SKIP_5XY0       2
+#define PROFILE_SKIP_9XY0       3
+#define PROFILE_SKIP_EX9E       4
+#define PROFILE_SKIP_EXA1       5
+#define PROFILE_SKIP_COUNT      6
+
+struct PROFILE_NODE                                     //one distinct call stack, the root is the code outside any subroutine
+{
+    ushort routine;                                     //physical entry address of the subroutine (BASE_RAM_OFFSET for the root)
+    unsigned int parent;
+    unsigned long long samples;                         //instructions executed with exactly this call stack
+    std::map<ushort, unsigned int> children;            //callee entry address -> node index
+};
+
+/*
+ * Guest code profile of one machine: executed instructions per opcode family and per address, taken/not taken
+ * counts of every skip, and a call tree built from 2NNN/00EE.  With a sample period of N only every Nth
+ * instruction is recorded (weighted by N, so the counts stay estimates of the totals); skips and calls are
+ * always counted exactly since the call tree has to follow every one of them.
+ */
+class CHIP8_PROFILER
+{
+    public:
+    CHIP8_PROFILER(unsigned int samplePeriod = 1);
+
+    void reset();
+    void setSamplePeriod(unsigned int period);          //1 = every instruction
+
+    void onInstruction(unsigned int address, ushort opcode)
+    {   //inline, it runs for every instruction while profiling
+        if(--sampleCountdown != 0)
+        {
+            return;
+        }
+        sampleCountdown = samplePeriod;
+        familyCounts[opcode >> 12] += samplePeriod;
+        heatmap[address & (XO_MEMORY_SIZE - 1)] += samplePeriod;
+        nodes[currentNode].samples += samplePeriod;
+    }
+    void onSkip(unsigned int skipType, unsigned int address, bool taken);
+    void onCall(unsigned int target);                   //after the return address was pushed
+    void onReturn();                                    //after the return address was popped
+
+    int writeJSON(const char *filename);
+    int writeFolded(const char *filename);              //one "main;sub_0x2a4;sub_0x31c count" line per call stack, for flamegraph.pl
+
+    private:
+    void writeFoldedNode(std::ostream &out, unsigned int node, std::string &path);
+
+    unsigned int samplePeriod;
+    unsigned int sampleCountdown;
+    unsigned long long familyCounts[PROFILE_FAMILY_COUNT];
+    std::vector<unsigned long long> heatmap;            //XO_MEMORY_SIZE entries, any platform's addresses fit
+    unsigned long long skipCounts[PROFILE_SKIP_COUNT][2];   //[type][taken]
+    std::vector<unsigned long long> skipSiteCounts[2];  //[taken] per address, XO_MEMORY_SIZE entries each
+    std::vector<PROFILE_NODE> nodes;
+    unsigned int currentNode;
+    unsigned int depth;
+    unsigned int maxDepth;
+    unsigned long long calls;
+    unsigned long long returns;
+    unsigned long long unbalancedReturns;               //00EE with no 2NNN seen for it (profiling started inside a subroutine)
+};
@@ -0,0 +1,187 @@
+/* Chip 8 Emulator  <chip8_quirks.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "chip8_quirks.h"
+
+using namespace std;
+
+struct QUIRK_NAME
+{
+    const char *name;
+    unsigned int quirks;
+};
+
+static const QUIRK_NAME profileNames[] =
+{
+    { "default", QUIRKS_DEFAULT },
+    { "vip",     QUIRKS_VIP },
+    { "chip48",  QUIRKS_CHIP48 },
+    { "schip",   QUIRKS_SCHIP },
+    { "xochip",  QUIRKS_XOCHIP },
+};
+
+static const QUIRK_NAME quirkNames[] =
+{
+    { "shift",    QUIRK_SHIFT_VY },
+    { "index",    QUIRK_INDEX_PLUS_X },
+    { "index+1",  QUIRK_INDEX_PLUS_X1 },
+    { "jump",     QUIRK_JUMP_VX },
+    { "vf-reset", QUIRK_VF_RESET },
+};
+
+static const QUIRK_NAME platformNames[PLATFORM_COUNT] =
+{
+    { "chip8",  QUIRKS_DEFAULT },
+    { "schip",  QUIRKS_SCHIP },
+    { "xochip", QUIRKS_XOCHIP },
+};
+
+#define NAME_COUNT(table)   (sizeof(table) / sizeof(table[0]))
+
+int parseQuirks(const char *text, unsigned int *quirks)
+{
+    for(unsigned int p = 0; p < NAME_COUNT(profileNames); p++)
+    {
+        if(strcmp(text, profileNames[p].name) == 0)
+        {
+            *quirks = profileNames[p].quirks;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    unsigned int parsed = 0;
+    while(*text != '\0')
+    {
+        size_t length = strcspn(text, ",");
+        unsigned int q = 0;
+        while(q < NAME_COUNT(quirkNames) && (strlen(quirkNames[q].name) != length || strncmp(text, quirkNames[q].name, length) != 0))
+        {
+            q++;
+        }
+        if(q == NAME_COUNT(quirkNames) || ((parsed & QUIRK_INDEX_MASK) != 0 && (quirkNames[q].quirks & QUIRK_INDEX_MASK) != 0))
+        {   //unknown name, or both index behaviors at once
+            return ERR_INVALID_ARGUMENT;
+        }
+        parsed |= quirkNames[q].quirks;
+        text += (text[length] == ',') ? length + 1 : length;
+    }
+    *quirks = parsed;
+    return STATUS_SUCCESS;
+}
+
+string getQuirksName(unsigned int quirks)
+{
+    for(unsigned int p = 0; p < NAME_COUNT(profileNames); p++)
+    {
+        if(quirks == profileNames[p].quirks)
+        {
+            return profileNames[p].name;
+        }
+    }
+    string name;
+    for(unsigned int q = 0; q < NAME_COUNT(quirkNames); q++)
+    {
+        unsigned int bits = quirkNames[q].quirks;
+        if((quirks & ((bits & QUIRK_INDEX_MASK) ? QUIRK_INDEX_MASK : bits)) == bits)
+        {
+            name += (name.empty() ? "" : ",") + string(quirkNames[q].name);
+        }
+    }
+    return name;
+}
+
+int parsePlatform(const char *text, unsigned int *platform)
+{
+    for(unsigned int p = 0; p < PLATFORM_COUNT; p++)
+    {
+        if(strcmp(text, platformNames[p].name) == 0)
+        {
+            *platform = p;
+            return STATUS_SUCCESS;
+        }
+    }
+    return ERR_INVALID_ARGUMENT;
+}
+
+const char *getPlatformName(unsigned int platform)
+{
+    return (platform < PLATFORM_COUNT) ? platformNames[platform].name : "unknown";
+}
+
+unsigned int getPlatformQuirks(unsigned int platform)
+{
+    return (platform < PLATFORM_COUNT) ? platformNames[platform].quirks : QUIRKS_DEFAULT;
+}
+
+int CHIP8_QUIRK_DATABASE::load(const char *filename)
+{
+    ifstream in(filename);
+    if(!in.is_open())
+    {
+        cerr << "Unable to open quirk database!" << endl;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+    string line;
+    unsigned int lineNumber = 0;
+    while(getline(in, line))
+    {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if(comment != string::npos)
+        {
+            line.resize(comment);
+        }
+        char hashText[32];
+        char quirkText[64];
+        int fields = sscanf(line.c_str(), "%31s %63s", hashText, quirkText);
+        if(fields <= 0)
+        {   //blank or comment only
+            continue;
+        }
+        char *end = NULL;
+        unsigned long long hash = strtoull(hashText, &end, 16);
+        unsigned int quirks = 0;
+        if(fields != 2 || *end != '\0' || parseQuirks(quirkText, &quirks) != STATUS_SUCCESS)
+        {
+            cerr << filename << ":" << lineNumber << ": expected <hash> <quirks> [title]" << endl;
+            return ERR_INVALID_ARGUMENT;
+        }
+        entries[hash] = quirks;
+    }
+    return STATUS_SUCCESS;
+}
+
+bool CHIP8_QUIRK_DATABASE::lookup(unsigned long long contentHash, unsigned int *quirks)
+{
+    map<unsigned long long, unsigned int>::iterator entry = entries.find(contentHash);
+    if(entry == entries.end())
+    {
+        return false;
+    }
+    *quirks = entry->second;
+    return true;
+}
+
+unsigned int CHIP8_QUIRK_DATABASE::getEntryCount()
+{
+    return entries.size();
+}
@@ -0,0 +1,50 @@
+/* Chip 8 Emulator  <chip8_quirks.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <map>
+#include <string>
+#include "chip8.h"
+
+#define QUIRKS_DEFAULT      0                                                   //this emulator's own behavior
+#define QUIRKS_VIP          (QUIRK_SHIFT_VY | QUIRK_INDEX_PLUS_X1 | QUIRK_VF_RESET) //COSMAC VIP
+#define QUIRKS_CHIP48       (QUIRK_INDEX_PLUS_X | QUIRK_JUMP_VX)                //CHIP-48 (HP-48)
+#define QUIRKS_SCHIP        (QUIRK_JUMP_VX)                                     //SUPER-CHIP 1.1
+#define QUIRKS_XOCHIP       (QUIRK_SHIFT_VY | QUIRK_INDEX_PLUS_X1)              //XO-CHIP (Octo)
+
+int parseQuirks(const char *text, unsigned int *quirks);   //"vip", "schip"... or a list such as "shift,jump,index+1"
+std::string getQuirksName(unsigned int quirks);             //profile name when one matches, otherwise the list form
+int parsePlatform(const char *text, unsigned int *platform);   //"chip8", "schip" or "xochip"
+const char *getPlatformName(unsigned int platform);
+unsigned int getPlatformQuirks(unsigned int platform);      //the profile a platform's ROMs expect when nothing else says
+
+/*
+ * Quirk profiles of known ROMs, keyed by CHIP8_ROM_IMAGE::contentHash.  The file is plain text, one ROM per line:
+ *     <hash> <quirks> [title]
+ * where hash is the 64-bit FNV-1a of the ROM in hex (as printed by a headless run) and quirks is anything
+ * parseQuirks() takes.  Everything after a '#' is a comment.
+ */
+class CHIP8_QUIRK_DATABASE
+{
+    public:
+    int load(const char *filename);                     //adds the file's entries, ERR_INVALID_ARGUMENT names the first bad line on stderr
+    bool lookup(unsigned long long contentHash, unsigned int *quirks);
+    unsigned int getEntryCount();
+
+    private:
+    std::map<unsigned long long, unsigned int> entries;
+};
@@ -0,0 +1,313 @@
+/* Chip 8 Emulator  <chip8_replay.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include "chip8_replay.h"
+#include "chip8_audio.h"
+
+using namespace std;
+
+CHIP8_RECORDER::CHIP8_RECORDER()
+{
+    lastInstruction = 0;
+    lastKeys = 0;
+}
+
+CHIP8_RECORDER::~CHIP8_RECORDER()
+{
+    flush();
+}
+
+int CHIP8_RECORDER::open(const char *filename, CHIP8_EMULATOR &emulator)
+{
+    outFile.open(filename, ios::binary | ios::trunc);
+    if(!outFile.is_open())
+    {
+        cerr << "Unable to open replay log for writing!" << endl;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+    vector<unsigned char> snapshot;
+    emulator.saveState(snapshot);
+
+    buffer.clear();
+    buffer.reserve(REPLAY_BUFFER_SIZE);
+    for(int i = 0; i < 4; i++)
+    {
+        buffer.push_back((unsigned char) (REPLAY_MAGIC >> (8 * i)));
+    }
+    buffer.push_back(REPLAY_VERSION & 0xFF);
+    buffer.push_back(REPLAY_VERSION >> 8);
+    for(int i = 0; i < 4; i++)
+    {
+        buffer.push_back((unsigned char) (snapshot.size() >> (8 * i)));
+    }
+    buffer.insert(buffer.end(), snapshot.begin(), snapshot.end());
+
+    lastInstruction = 0;
+    lastKeys = emulator.getKeyState();    //already part of the snapshot
+    return STATUS_SUCCESS;
+}
+
+void CHIP8_RECORDER::setKeyState(CHIP8_EMULATOR &emulator, ushort keys, unsigned long long instruction)
+{
+    emulator.setKeyState(keys);
+    if(keys != lastKeys && isOpen())
+    {   //only changes are logged, holding a key costs nothing
+        writeEvent(REPLAY_EVENT_KEY_STATE, instruction);
+        writeVarint(keys ^ lastKeys);
+        lastKeys = keys;
+    }
+}
+
+void CHIP8_RECORDER::tickTimers(CHIP8_EMULATOR &emulator, unsigned long long instruction)
+{
+    emulator.tickTimers();
+    if(isOpen())
+    {
+        writeEvent(REPLAY_EVENT_TIMER_TICK, instruction);
+    }
+}
+
+int CHIP8_RECORDER::close(CHIP8_EMULATOR &emulator, unsigned long long instruction)
+{
+    if(!isOpen())
+    {
+        return ERR_INVALID_ARGUMENT;
+    }
+    writeEvent(REPLAY_EVENT_END, instruction);
+    writeVarint(emulator.getStateHash());
+    flush();
+    outFile.close();
+    return outFile.fail() ? ERR_UNABLE_OPEN_FILE : STATUS_SUCCESS;
+}
+
+bool CHIP8_RECORDER::isOpen()
+{
+    return outFile.is_open();
+}
+
+void CHIP8_RECORDER::writeEvent(unsigned int type, unsigned long long instruction)
+{
+    writeVarint(((instruction - lastInstruction) << 2) | type);
+    lastInstruction = instruction;
+}
+
+void CHIP8_RECORDER::writeVarint(unsigned long long value)
+{
+    //LEB128: 7 bits per byte, high bit set on every byte but the last
+    while(value >= 0x80)
+    {
+        buffer.push_back((unsigned char) (value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((unsigned char) value);
+    if(buffer.size() >= REPLAY_BUFFER_SIZE)
+    {
+        flush();
+    }
+}
+
+void CHIP8_RECORDER::flush()
+{
+    if(isOpen() && !buffer.empty())
+    {
+        outFile.write((const char *) buffer.data(), buffer.size());
+    }
+    buffer.clear();
+}
+
+CHIP8_REPLAYER::CHIP8_REPLAYER()
+{
+    bufferPos = 0;
+    bufferFill = 0;
+    lastInstruction = 0;
+    lastKeys = 0;
+    audio = NULL;
+}
+
+void CHIP8_REPLAYER::setAudio(CHIP8_AUDIO_SYNTH *audio)
+{
+    this -> audio = audio;
+}
+
+int CHIP8_REPLAYER::open(const char *filename, CHIP8_EMULATOR &emulator)
+{
+    inFile.open(filename, ios::binary);
+    if(!inFile.is_open())
+    {
+        cerr << "Unable to open replay log!" << endl;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+    buffer.resize(REPLAY_BUFFER_SIZE);
+    bufferPos = 0;
+    bufferFill = 0;
+
+    unsigned char header[10];
+    for(int i = 0; i < 10; i++)
+    {
+        if(!readByte(header[i]))
+        {
+            return ERR_INVALID_REPLAY;
+        }
+    }
+    unsigned int magic = header[0] | (header[1] << 8) | (header[2] << 16) | ((unsigned int) header[3] << 24);
+    unsigned int version = header[4] | (header[5] << 8);
+    unsigned int snapshotLength = header[6] | (header[7] << 8) | (header[8] << 16) | ((unsigned int) header[9] << 24);
+    if(magic != REPLAY_MAGIC || version != REPLAY_VERSION || snapshotLength > (1 << 20))
+    {
+        return ERR_INVALID_REPLAY;
+    }
+
+    vector<unsigned char> snapshot(snapshotLength);
+    for(unsigned int i = 0; i < snapshotLength; i++)
+    {
+        if(!readByte(snapshot[i]))
+        {
+            return ERR_INVALID_REPLAY;
+        }
+    }
+    if(emulator.loadState(snapshot.data(), snapshot.size()) != STATUS_SUCCESS)
+    {
+        return ERR_INVALID_REPLAY;
+    }
+    lastInstruction = 0;
+    lastKeys = emulator.getKeyState();
+    return STATUS_SUCCESS;
+}
+
+int CHIP8_REPLAYER::run(CHIP8_EMULATOR &emulator, unsigned long *executedCount)
+{
+    unsigned long long executed = 0;
+    int returnValue = STATUS_SUCCESS;
+    REPLAY_EVENT event;
+    while((returnValue = nextEvent(event)) == STATUS_SUCCESS)
+    {
+        //nothing but the log can change the machine, so run flat out to the next event
+        while(executed < event.instruction)
+        {
+            unsigned long ran = 0;
+            int status = emulator.runInstructions(event.instruction - executed, &ran);
+            executed += ran;
+            if(status != STATUS_SUCCESS)
+            {
+                break;
+            }
+        }
+        if(executed != event.instruction)
+        {   //stopped on an error the recording did not see
+            returnValue = ERR_REPLAY_DIVERGED;
+            break;
+        }
+
+        if(event.type == REPLAY_EVENT_TIMER_TICK)
+        {
+            if(audio != NULL)
+            {   //a logged tick is a frame boundary of the recorded run, so the replay sounds the same
+                audio->renderFrame(emulator);
+            }
+            emulator.tickTimers();
+        }
+        else if(event.type == REPLAY_EVENT_KEY_STATE)
+        {
+            emulator.setKeyState(event.payload);
+        }
+        else
+        {
+            returnValue = (emulator.getStateHash() == event.payload) ? STATUS_SUCCESS : ERR_REPLAY_DIVERGED;
+            break;
+        }
+    }
+    *executedCount = executed;
+    return returnValue;
+}
+
+int CHIP8_REPLAYER::nextEvent(REPLAY_EVENT &event)
+{
+    unsigned long long header = 0;
+    if(!readVarint(header))
+    {
+        return ERR_INVALID_REPLAY;   //a complete log always ends with REPLAY_EVENT_END
+    }
+    event.type = header & 3;
+    event.instruction = lastInstruction + (header >> 2);
+    event.payload = 0;
+    lastInstruction = event.instruction;
+
+    switch(event.type)
+    {
+        case REPLAY_EVENT_TIMER_TICK:
+            break;
+
+        case REPLAY_EVENT_KEY_STATE:
+        {
+            unsigned long long changed = 0;
+            if(!readVarint(changed) || changed > 0xFFFF)
+            {
+                return ERR_INVALID_REPLAY;
+            }
+            lastKeys ^= changed;
+            event.payload = lastKeys;
+            break;
+        }
+
+        case REPLAY_EVENT_END:
+            if(!readVarint(event.payload))
+            {
+                return ERR_INVALID_REPLAY;
+            }
+            break;
+
+        default:
+            return ERR_INVALID_REPLAY;
+    }
+    return STATUS_SUCCESS;
+}
+
+bool CHIP8_REPLAYER::readByte(unsigned char &value)
+{
+    if(bufferPos == bufferFill)
+    {   //refill, the file is only ever read front to back
+        inFile.read((char *) buffer.data(), buffer.size());
+        bufferFill = inFile.gcount();
+        bufferPos = 0;
+        if(bufferFill == 0)
+        {
+            return false;
+        }
+    }
+    value = buffer[bufferPos++];
+    return true;
+}
+
+bool CHIP8_REPLAYER::readVarint(unsigned long long &value)
+{
+    value = 0;
+    for(unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        unsigned char byte;
+        if(!readByte(byte))
+        {
+            return false;
+        }
+        value |= (unsigned long long) (byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;   //more than 10 bytes, not something writeVarint produced
+}
@@ -0,0 +1,93 @@
+/* Chip 8 Emulator  <chip8_replay.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include "chip8.h"
+
+class CHIP8_AUDIO_SYNTH;
+
+#define REPLAY_MAGIC                0x4C523843  //"C8RL" little endian
+#define REPLAY_VERSION              1
+#define REPLAY_BUFFER_SIZE          (1 << 16)   //bytes buffered between file reads/writes
+
+#define REPLAY_EVENT_TIMER_TICK     0           //host called tickTimers()
+#define REPLAY_EVENT_KEY_STATE      1           //key state changed, payload is the xor with the previous state
+#define REPLAY_EVENT_END            2           //end of the run, payload is the final CHIP8_EMULATOR::getStateHash()
+
+#define ERR_INVALID_REPLAY          -60         //log is truncated, corrupted or from another version
+#define ERR_REPLAY_DIVERGED         -61         //replay finished in a different state than the recording
+
+struct REPLAY_EVENT
+{
+    unsigned int type;                          //one of REPLAY_EVENT_*
+    unsigned long long instruction;             //instructions executed before the event took effect
+    unsigned long long payload;                 //key state for REPLAY_EVENT_KEY_STATE, state hash for REPLAY_EVENT_END
+};
+
+/*
+ * Log layout: magic u32, version u16, snapshot length u32, CHIP8_EMULATOR::saveState() blob of the machine at
+ * instruction 0, then a stream of events.  Each event is a varint of (instruction delta since the previous
+ * event << 2 | type) followed by a varint payload for key and end events.  The RNG state is part of the snapshot,
+ * so CXNN needs no events: only input that reaches the machine from the host (keys, timer ticks) is logged.
+ */
+class CHIP8_RECORDER
+{
+    public:
+    CHIP8_RECORDER();
+    ~CHIP8_RECORDER();
+
+    int open(const char *filename, CHIP8_EMULATOR &emulator);  //starts a log from the emulator's current state
+    void setKeyState(CHIP8_EMULATOR &emulator, ushort keys, unsigned long long instruction);  //applies the keys, logs them if they changed
+    void tickTimers(CHIP8_EMULATOR &emulator, unsigned long long instruction);  //ticks the timers and logs the tick
+    int close(CHIP8_EMULATOR &emulator, unsigned long long instruction);     //writes the end event and flushes the file
+    bool isOpen();
+
+    private:
+    void writeEvent(unsigned int type, unsigned long long instruction);
+    void writeVarint(unsigned long long value);
+    void flush();
+
+    std::ofstream outFile;
+    std::vector<unsigned char> buffer;
+    unsigned long long lastInstruction;         //instruction count of the previous event, events store the delta
+    ushort lastKeys;
+};
+
+class CHIP8_REPLAYER
+{
+    public:
+    CHIP8_REPLAYER();
+
+    int open(const char *filename, CHIP8_EMULATOR &emulator);  //reads the header and restores the recorded starting state
+    void setAudio(CHIP8_AUDIO_SYNTH *audio);            //render a frame of samples at every logged timer tick (NULL = off)
+    int run(CHIP8_EMULATOR &emulator, unsigned long *executedCount);    //plays the whole log, checks the final state hash
+    int nextEvent(REPLAY_EVENT &event);         //reads the next event, ERR_INVALID_REPLAY at a malformed or missing one
+
+    private:
+    bool readByte(unsigned char &value);
+    bool readVarint(unsigned long long &value);
+
+    std::ifstream inFile;
+    std::vector<unsigned char> buffer;
+    size_t bufferPos;
+    size_t bufferFill;
+    unsigned long long lastInstruction;
+    ushort lastKeys;
+    CHIP8_AUDIO_SYNTH *audio;
+};
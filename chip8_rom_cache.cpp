@@ -0,0 +1,437 @@
+/* Chip 8 Emulator  <chip8_rom_cache.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "chip8_rom_cache.h"
+
+using namespace std;
+
+#define TAR_BLOCK_SIZE          512
+#define ZIP_LOCAL_HEADER_SIG    0x04034B50
+#define ZIP_CENTRAL_HEADER_SIG  0x02014B50
+#define ZIP_END_OF_DIR_SIG      0x06054B50
+#define ZIP_END_OF_DIR_SIZE     22
+#define ZIP_METHOD_STORED       0
+#define ZIP_METHOD_DEFLATED     8
+
+static unsigned int le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static unsigned long long tarNumber(const unsigned char *field, unsigned int length)
+{
+    unsigned long long value = 0;
+    if(field[0] & 0x80)
+    {   //GNU base-256 extension for sizes that do not fit in octal
+        for(unsigned int i = 1; i < length; i++)
+        {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+    for(unsigned int i = 0; i < length && field[i] >= '0' && field[i] <= '7'; i++)
+    {
+        value = (value << 3) | (field[i] - '0');
+    }
+    return value;
+}
+
+static string tarString(const unsigned char *field, unsigned int length)
+{
+    return string((const char *) field, strnlen((const char *) field, length));
+}
+
+CHIP8_ROM_CACHE& CHIP8_ROM_CACHE::getInstance()
+{
+    static CHIP8_ROM_CACHE cache;
+    return cache;
+}
+
+CHIP8_ROM_CACHE::CHIP8_ROM_CACHE()
+{
+    hits = 0;
+    misses = 0;
+}
+
+int CHIP8_ROM_CACHE::getROM(const string &path, shared_ptr<const CHIP8_ROM_IMAGE> &image)
+{
+    lock_guard<mutex> guard(lock);
+    map<string, ENTRY>::iterator it = entries.find(path);
+    if(it != entries.end())
+    {
+        hits++;
+    }
+    else
+    {
+        misses++;
+        struct stat info;
+        size_t separator = path.rfind(ARCHIVE_MEMBER_SEPARATOR);
+        if(stat(path.c_str(), &info) == 0 || separator == string::npos)
+        {
+            loadFile(path);
+        }
+        else if(archives.find(path.substr(0, separator)) == archives.end())
+        {   //archive:member, index the archive on first use
+            loadFile(path.substr(0, separator));
+        }
+
+        it = entries.find(path);
+        if(it == entries.end())
+        {   //remember the failure too, a bad path in a batch should not be retried for every job
+            ENTRY missing;
+            missing.status = ERR_UNABLE_OPEN_FILE;
+            it = entries.insert(make_pair(path, missing)).first;
+        }
+    }
+    image = it->second.image;
+    return it->second.status;
+}
+
+int CHIP8_ROM_CACHE::listArchive(const string &archivePath, vector<string> &members)
+{
+    lock_guard<mutex> guard(lock);
+    if(archives.find(archivePath) == archives.end() && entries.find(archivePath) == entries.end())
+    {   //not seen yet, reading it also caches it when it turns out to be a plain ROM
+        int returnValue = loadFile(archivePath);
+        if(returnValue != STATUS_SUCCESS)
+        {
+            return returnValue;
+        }
+    }
+    map<string, vector<string> >::iterator it = archives.find(archivePath);
+    if(it == archives.end())
+    {   //a plain file, not an archive
+        return ERR_INVALID_ARGUMENT;
+    }
+    members = it->second;
+    return STATUS_SUCCESS;
+}
+
+void CHIP8_ROM_CACHE::clear()
+{
+    lock_guard<mutex> guard(lock);
+    entries.clear();
+    byContent.clear();
+    archives.clear();
+}
+
+unsigned int CHIP8_ROM_CACHE::getImageCount()
+{
+    lock_guard<mutex> guard(lock);
+    unsigned int count = 0;
+    for(map<unsigned long long, vector<shared_ptr<const CHIP8_ROM_IMAGE> > >::iterator it = byContent.begin(); it != byContent.end(); it++)
+    {
+        count += it->second.size();
+    }
+    return count;
+}
+
+unsigned long CHIP8_ROM_CACHE::getHits()
+{
+    lock_guard<mutex> guard(lock);
+    return hits;
+}
+
+unsigned long CHIP8_ROM_CACHE::getMisses()
+{
+    lock_guard<mutex> guard(lock);
+    return misses;
+}
+
+int CHIP8_ROM_CACHE::loadFile(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+        return ERR_UNABLE_OPEN_FILE;    //not cached here, getROM() decides what a missing path means
+    }
+
+    size_t length = info.st_size;
+    const unsigned char *data = NULL;
+    if(length > 0)
+    {
+        void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED)
+        {
+            close(fd);
+            return ERR_UNABLE_OPEN_FILE;
+        }
+        data = (const unsigned char *) mapping;
+    }
+    close(fd);  //the mapping stays valid without the descriptor
+
+    int returnValue = STATUS_SUCCESS;
+    if(length >= 4 && (le32(data) == ZIP_LOCAL_HEADER_SIG || le32(data) == ZIP_END_OF_DIR_SIG))
+    {
+        returnValue = indexZip(path, data, length);
+    }
+    else if(length >= TAR_BLOCK_SIZE && memcmp(data + 257, "ustar", 5) == 0)
+    {
+        returnValue = indexTar(path, data, length);
+    }
+    else
+    {
+        addImage(path, data, length);
+        returnValue = entries[path].status;
+    }
+    if(archives.find(path) != archives.end())
+    {   //an archive is not a ROM itself, only its members are
+        ENTRY entry;
+        entry.status = (returnValue == STATUS_SUCCESS) ? ERR_CORRUPTED_ROM : returnValue;
+        entries[path] = entry;
+    }
+
+    if(data != NULL)
+    {
+        munmap((void *) data, length);
+    }
+    return returnValue;
+}
+
+int CHIP8_ROM_CACHE::indexTar(const string &archivePath, const unsigned char *data, size_t length)
+{
+    vector<string> &members = archives[archivePath];
+    string longName;
+    size_t offset = 0;
+    while(offset + TAR_BLOCK_SIZE <= length && data[offset] != 0)   //an all-zero block ends the archive
+    {
+        const unsigned char *header = data + offset;
+        unsigned int checksum = 0;
+        for(unsigned int i = 0; i < TAR_BLOCK_SIZE; i++)
+        {   //the checksum field itself counts as spaces
+            checksum += (i >= 148 && i < 156) ? ' ' : header[i];
+        }
+        if(checksum != tarNumber(header + 148, 8))
+        {
+            return ERR_CORRUPTED_ROM;
+        }
+
+        unsigned long long size = tarNumber(header + 124, 12);
+        char type = header[156];
+        string name = tarString(header, 100);
+        string prefix = tarString(header + 345, 155);
+        if(!longName.empty())
+        {
+            name = longName;
+            longName.clear();
+        }
+        else if(!prefix.empty())
+        {
+            name = prefix + "/" + name;
+        }
+        offset += TAR_BLOCK_SIZE;
+        if(size > length - offset)
+        {
+            return ERR_CORRUPTED_ROM;
+        }
+
+        if(type == 'L')
+        {   //GNU long name, applies to the next header
+            longName = tarString(data + offset, size);
+        }
+        else if(type == '0' || type == '\0')
+        {
+            string member = archivePath + ARCHIVE_MEMBER_SEPARATOR + name;
+            addImage(member, data + offset, size);
+            if(entries[member].status == STATUS_SUCCESS)
+            {
+                members.push_back(member);
+            }
+        }
+        offset += (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+    }
+    return STATUS_SUCCESS;
+}
+
+int CHIP8_ROM_CACHE::indexZip(const string &archivePath, const unsigned char *data, size_t length)
+{
+    vector<string> &members = archives[archivePath];
+
+    //the central directory is found through the end record, which sits behind an optional comment of up to 64K
+    if(length < ZIP_END_OF_DIR_SIZE)
+    {
+        return ERR_CORRUPTED_ROM;
+    }
+    const unsigned char *end = NULL;
+    size_t lowest = (length > ZIP_END_OF_DIR_SIZE + 0xFFFF) ? length - ZIP_END_OF_DIR_SIZE - 0xFFFF : 0;
+    for(size_t pos = length - ZIP_END_OF_DIR_SIZE + 1; pos-- > lowest; )
+    {
+        if(le32(data + pos) == ZIP_END_OF_DIR_SIG)
+        {
+            end = data + pos;
+            break;
+        }
+    }
+    if(end == NULL)
+    {
+        return ERR_CORRUPTED_ROM;
+    }
+    unsigned int entryCount = le16(end + 10);
+    size_t directoryOffset = le32(end + 16);
+
+    size_t pos = directoryOffset;
+    vector<unsigned char> inflated;
+    for(unsigned int e = 0; e < entryCount; e++)
+    {
+        if(pos + 46 > length || le32(data + pos) != ZIP_CENTRAL_HEADER_SIG)
+        {
+            return ERR_CORRUPTED_ROM;
+        }
+        const unsigned char *header = data + pos;
+        unsigned int flags = le16(header + 8);
+        unsigned int method = le16(header + 10);
+        unsigned int crc = le32(header + 16);
+        size_t compressedSize = le32(header + 20);
+        size_t size = le32(header + 24);
+        unsigned int nameLength = le16(header + 28);
+        size_t localOffset = le32(header + 42);
+        pos += 46 + nameLength + le16(header + 30) + le16(header + 32);
+        if(pos > length)
+        {
+            return ERR_CORRUPTED_ROM;
+        }
+        string name((const char *) header + 46, nameLength);
+        string member = archivePath + ARCHIVE_MEMBER_SEPARATOR + name;
+        if(name.empty() || name[name.size() - 1] == '/')
+        {   //directory
+            continue;
+        }
+
+        ENTRY failed;
+        failed.status = STATUS_SUCCESS;
+        if(localOffset + 30 > length || le32(data + localOffset) != ZIP_LOCAL_HEADER_SIG)
+        {
+            return ERR_CORRUPTED_ROM;
+        }
+        size_t dataOffset = localOffset + 30 + le16(data + localOffset + 26) + le16(data + localOffset + 28);
+        if(dataOffset > length || compressedSize > length - dataOffset)
+        {
+            return ERR_CORRUPTED_ROM;
+        }
+        if(size > XO_MEMORY_SIZE - BASE_RAM_OFFSET)
+        {
+            failed.status = ERR_ROM_GREATER_THAN_RAM;
+        }
+        else if((flags & 1) || (method != ZIP_METHOD_STORED && method != ZIP_METHOD_DEFLATED))
+        {   //encrypted, or compressed with something other than deflate
+            failed.status = ERR_UNSUPPORTED_ARCHIVE;
+        }
+        else if(method == ZIP_METHOD_STORED)
+        {
+            inflated.assign(data + dataOffset, data + dataOffset + compressedSize);
+        }
+        else
+        {
+            inflated.resize(size + 1);  //one spare byte so a member longer than its header says is caught
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            stream.next_in = (Bytef *) (data + dataOffset);
+            stream.avail_in = compressedSize;
+            stream.next_out = inflated.data();
+            stream.avail_out = inflated.size();
+            int zStatus = inflateInit2(&stream, -MAX_WBITS);   //raw deflate, zip has its own headers
+            if(zStatus == Z_OK)
+            {
+                zStatus = inflate(&stream, Z_FINISH);
+                inflateEnd(&stream);
+            }
+            if(zStatus != Z_STREAM_END || stream.total_out != size)
+            {
+                failed.status = ERR_CORRUPTED_ROM;
+            }
+            inflated.resize(size);
+        }
+        if(failed.status == STATUS_SUCCESS && crc32(0, inflated.data(), inflated.size()) != crc)
+        {
+            failed.status = ERR_CORRUPTED_ROM;
+        }
+
+        if(failed.status != STATUS_SUCCESS)
+        {
+            entries[member] = failed;
+            continue;
+        }
+        addImage(member, inflated.data(), inflated.size());
+        members.push_back(member);
+    }
+    return STATUS_SUCCESS;
+}
+
+void CHIP8_ROM_CACHE::addImage(const string &name, const unsigned char *data, size_t length)
+{
+    ENTRY entry;
+    if(length > XO_MEMORY_SIZE - BASE_RAM_OFFSET)
+    {   //whether it fits the machine's platform is up to CHIP8_EMULATOR::loadROM
+        entry.status = ERR_ROM_GREATER_THAN_RAM;
+        entries[name] = entry;
+        return;
+    }
+    entry.status = STATUS_SUCCESS;
+
+    unsigned long long hash = 0xCBF29CE484222325ULL;    //64-bit FNV-1a
+    for(size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+
+    //same bytes under another name share the image (and with it every machine's unwritten pages)
+    vector<shared_ptr<const CHIP8_ROM_IMAGE> > &sameHash = byContent[hash];
+    for(unsigned int i = 0; i < sameHash.size() && !entry.image; i++)
+    {
+        bool same = sameHash[i]->size == length;
+        for(size_t b = 0; same && b < length; b++)
+        {
+            same = sameHash[i]->memory.read(BASE_RAM_OFFSET + b) == data[b];
+        }
+        if(same)
+        {
+            entry.image = sameHash[i];
+        }
+    }
+    if(!entry.image)
+    {
+        shared_ptr<CHIP8_ROM_IMAGE> image(new CHIP8_ROM_IMAGE());
+        image->name = name;
+        image->size = length;
+        image->contentHash = hash;
+        CHIP8_EMULATOR::initMemory(image->memory);
+        if(length > SIZE_OF_RAM)
+        {   //only an XO-CHIP machine can load it
+            image->memory.resize(XO_MEMORY_SIZE);
+        }
+        image->memory.load(BASE_RAM_OFFSET, data, length);
+        sameHash.push_back(image);
+        entry.image = image;
+    }
+    entries[name] = entry;
+}
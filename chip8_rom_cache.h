@@ -0,0 +1,73 @@
+/* Chip 8 Emulator  <chip8_rom_cache.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+#define ARCHIVE_MEMBER_SEPARATOR    ':'         //"games.zip:PONG.ch8" names one member of an archive
+
+struct CHIP8_ROM_IMAGE
+{
+    std::string name;                           //path (or archive:member) the image was first loaded from
+    unsigned int size;                          //bytes of ROM
+    unsigned long long contentHash;             //FNV-1a over the ROM bytes
+    CHIP8_MEMORY memory;                        //font plus ROM at BASE_RAM_OFFSET, machines share these pages until they write
+};
+
+/*
+ * Process-wide cache of loaded ROMs.  Every file is mmap'ed and parsed once, after that loading a ROM into a
+ * machine only copies page references.  ROMs with identical contents share one image whatever path they came
+ * from.  Members of .tar and .zip archives (stored or deflated) are addressed as "archive:member"; the first
+ * lookup indexes the whole archive.  Files are assumed not to change while cached, clear() forgets everything.
+ */
+class CHIP8_ROM_CACHE
+{
+    public:
+    static CHIP8_ROM_CACHE& getInstance();
+
+    int getROM(const std::string &path, std::shared_ptr<const CHIP8_ROM_IMAGE> &image);   //thread safe
+    int listArchive(const std::string &archivePath, std::vector<std::string> &members);   //"archive:member" names of every ROM-sized member
+    void clear();
+    unsigned int getImageCount();               //distinct ROM contents held
+    unsigned long getHits();
+    unsigned long getMisses();                  //lookups that had to read a file
+
+    private:
+    struct ENTRY
+    {
+        int status;                             //STATUS_SUCCESS or why the file/member cannot be loaded
+        std::shared_ptr<const CHIP8_ROM_IMAGE> image;
+    };
+
+    CHIP8_ROM_CACHE();
+    int loadFile(const std::string &path);      //reads a file or a whole archive into entries (lock held)
+    int indexTar(const std::string &archivePath, const unsigned char *data, size_t length);
+    int indexZip(const std::string &archivePath, const unsigned char *data, size_t length);
+    void addImage(const std::string &name, const unsigned char *data, size_t length);
+
+    std::mutex lock;
+    std::map<std::string, ENTRY> entries;       //by path or archive:member
+    std::map<unsigned long long, std::vector<std::shared_ptr<const CHIP8_ROM_IMAGE> > > byContent;
+    std::map<std::string, std::vector<std::string> > archives;  //members of every archive read so far
+    unsigned long hits;
+    unsigned long misses;
+};
@@ -0,0 +1,261 @@
+/* Chip 8 Emulator  <chip8_romgen.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <cstdlib>
+#include "chip8_romgen.h"
+
+/*
+ * Register use of generated code:
+ *   V0-V9  operands of the ALU, load, random, memory and draw families
+ *   VA     bumped by the subroutine
+ *   VB     fresh random bit tested by ROMGEN_BRANCH_RANDOM skips
+ *   VC     always 0, VE always 1: constants for the skip conditions
+ *   VD     flipped at the top of every pass for ROMGEN_BRANCH_ALTERNATING
+ *   VF     flags, written by the ALU family only
+ */
+#define GENERAL_REGISTER_COUNT  10
+#define SUBROUTINE_ADDRESS      0x00A       //logical address of "7A01 00EE", right behind the prologue
+#define LOOP_ADDRESS            0x00E       //logical address of the first loop instruction
+
+using namespace std;
+
+static const char *familyNames[ROMGEN_FAMILY_COUNT] = { "alu", "load", "skip", "memory", "draw", "random", "call" };
+static const char *branchPatternNames[ROMGEN_BRANCH_COUNT] = { "never", "always", "alternating", "random" };
+
+static const ushort aluOperations[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+
+//the four skip forms of each pattern, X/Y already filled in (see the register use above)
+static const ushort skipOpcodes[ROMGEN_BRANCH_COUNT][4] =
+{
+    { 0x3C01, 0x4C00, 0x5CE0, 0x9CC0 },     //VC == 1, VC != 0, VC == VE, VC != VC: never true
+    { 0x3C00, 0x4C01, 0x5CC0, 0x9CE0 },     //always true
+    { 0x3D00, 0x4D01, 0x5DC0, 0x9DE0 },     //true while VD == 0
+    { 0x3B00, 0x4B01, 0x5BC0, 0x9BE0 },     //true while VB == 0
+};
+
+CHIP8_ROM_GENERATOR::CHIP8_ROM_GENERATOR()
+{
+    weights[ROMGEN_FAMILY_ALU] = 40;
+    weights[ROMGEN_FAMILY_LOAD] = 20;
+    weights[ROMGEN_FAMILY_SKIP] = 15;
+    weights[ROMGEN_FAMILY_MEMORY] = 10;
+    weights[ROMGEN_FAMILY_DRAW] = 5;
+    weights[ROMGEN_FAMILY_RANDOM] = 5;
+    weights[ROMGEN_FAMILY_CALL] = 5;
+    branchPattern = ROMGEN_BRANCH_ALTERNATING;
+    length = ROMGEN_DEFAULT_LENGTH;
+    seed = 0;
+    rngState = 1;
+}
+
+void CHIP8_ROM_GENERATOR::setWeight(unsigned int family, unsigned int weight)
+{
+    if(family < ROMGEN_FAMILY_COUNT)
+    {
+        weights[family] = weight;
+    }
+}
+
+int CHIP8_ROM_GENERATOR::setMix(const char *mix)
+{
+    while(*mix != '\0')
+    {
+        const char *separator = strchr(mix, '=');
+        if(separator == NULL)
+        {
+            return ERR_INVALID_ARGUMENT;
+        }
+        unsigned int family = 0;
+        while(family < ROMGEN_FAMILY_COUNT && (strlen(familyNames[family]) != (size_t) (separator - mix) ||
+              strncmp(mix, familyNames[family], separator - mix) != 0))
+        {
+            family++;
+        }
+        char *end = NULL;
+        unsigned long weight = strtoul(separator + 1, &end, 0);
+        if(family == ROMGEN_FAMILY_COUNT || end == separator + 1 || (*end != ',' && *end != '\0'))
+        {
+            return ERR_INVALID_ARGUMENT;
+        }
+        weights[family] = weight;
+        mix = (*end == ',') ? end + 1 : end;
+    }
+    return STATUS_SUCCESS;
+}
+
+int CHIP8_ROM_GENERATOR::setBranchPattern(const char *pattern)
+{
+    for(unsigned int p = 0; p < ROMGEN_BRANCH_COUNT; p++)
+    {
+        if(strcmp(pattern, branchPatternNames[p]) == 0)
+        {
+            branchPattern = p;
+            return STATUS_SUCCESS;
+        }
+    }
+    return ERR_INVALID_ARGUMENT;
+}
+
+void CHIP8_ROM_GENERATOR::setBranchPattern(unsigned int pattern)
+{
+    if(pattern < ROMGEN_BRANCH_COUNT)
+    {
+        branchPattern = pattern;
+    }
+}
+
+void CHIP8_ROM_GENERATOR::setLength(unsigned int instructions)
+{
+    length = instructions;
+    if(length < 1)
+    {
+        length = 1;
+    }
+    if(length > ROMGEN_MAX_LENGTH)
+    {
+        length = ROMGEN_MAX_LENGTH;
+    }
+}
+
+void CHIP8_ROM_GENERATOR::setSeed(unsigned long long seed)
+{
+    this -> seed = seed;
+}
+
+const char* CHIP8_ROM_GENERATOR::getFamilyName(unsigned int family)
+{
+    return (family < ROMGEN_FAMILY_COUNT) ? familyNames[family] : "?";
+}
+
+const char* CHIP8_ROM_GENERATOR::getBranchPatternName(unsigned int pattern)
+{
+    return (pattern < ROMGEN_BRANCH_COUNT) ? branchPatternNames[pattern] : "?";
+}
+
+void CHIP8_ROM_GENERATOR::emit(vector<unsigned char> &rom, ushort opcode)
+{
+    rom.push_back(opcode >> 8);     //opcodes are stored big endian
+    rom.push_back(opcode & 0xFF);
+}
+
+unsigned int CHIP8_ROM_GENERATOR::nextRandom(unsigned int range)
+{
+    rngState = chip8StepRNG(rngState);
+    return (rngState >> 8) % range;
+}
+
+unsigned int CHIP8_ROM_GENERATOR::pickFamily()
+{
+    unsigned int total = 0;
+    for(unsigned int f = 0; f < ROMGEN_FAMILY_COUNT; f++)
+    {
+        total += weights[f];
+    }
+    if(total == 0)
+    {
+        return ROMGEN_FAMILY_ALU;   //an all-zero mix still has to produce something
+    }
+    unsigned int pick = nextRandom(total);
+    unsigned int family = 0;
+    while(pick >= weights[family])
+    {
+        pick -= weights[family];
+        family++;
+    }
+    return family;
+}
+
+void CHIP8_ROM_GENERATOR::generate(vector<unsigned char> &rom)
+{
+    rngState = chip8SeedToRNGState(seed);
+    rom.clear();
+
+    //prologue: constants, I on the data area, then jump over the subroutine into the loop
+    emit(rom, 0x6C00);
+    emit(rom, 0x6D00);
+    emit(rom, 0x6E01);
+    emit(rom, 0xA000 | ROMGEN_DATA_ADDRESS);
+    emit(rom, 0x1000 | LOOP_ADDRESS);
+    emit(rom, 0x7A01);
+    emit(rom, 0x00EE);
+
+    if(branchPattern == ROMGEN_BRANCH_ALTERNATING)
+    {
+        emit(rom, 0x8DE3);  //VD ^= 1 once per pass
+    }
+
+    unsigned int emitted = 0;
+    bool afterSkip = false;
+    while(emitted < length || afterSkip)
+    {
+        unsigned int x = nextRandom(GENERAL_REGISTER_COUNT);
+        unsigned int y = nextRandom(GENERAL_REGISTER_COUNT);
+        unsigned int family = pickFamily();
+        if(afterSkip)
+        {   //the instruction a skip jumps over must be a whole one, never half of a pair or the loop jump
+            family = (family == ROMGEN_FAMILY_ALU) ? ROMGEN_FAMILY_ALU : ROMGEN_FAMILY_LOAD;
+            afterSkip = false;
+        }
+
+        switch(family)
+        {
+            case ROMGEN_FAMILY_ALU:
+                emit(rom, 0x8000 | (x << 8) | (y << 4) | aluOperations[nextRandom(sizeof(aluOperations) / sizeof(aluOperations[0]))]);
+                break;
+
+            case ROMGEN_FAMILY_LOAD:
+                emit(rom, (nextRandom(2) ? 0x7000 : 0x6000) | (x << 8) | nextRandom(0x100));
+                break;
+
+            case ROMGEN_FAMILY_SKIP:
+                if(branchPattern == ROMGEN_BRANCH_RANDOM)
+                {
+                    emit(rom, 0xCB01);
+                    emitted++;
+                }
+                emit(rom, skipOpcodes[branchPattern][nextRandom(4)]);
+                afterSkip = true;
+                break;
+
+            case ROMGEN_FAMILY_MEMORY:
+            {
+                static const ushort memoryOperations[] = { 0x55, 0x65, 0x33 };
+                emit(rom, 0xA000 | (ROMGEN_DATA_ADDRESS + nextRandom(0xF0)));
+                emit(rom, 0xF000 | (x << 8) | memoryOperations[nextRandom(3)]);
+                emitted++;
+                break;
+            }
+
+            case ROMGEN_FAMILY_DRAW:
+                emit(rom, 0xF029 | (x << 8));
+                emit(rom, 0xD005 | (x << 8) | (y << 4));
+                emitted++;
+                break;
+
+            case ROMGEN_FAMILY_RANDOM:
+                emit(rom, 0xC000 | (x << 8) | nextRandom(0x100));
+                break;
+
+            case ROMGEN_FAMILY_CALL:
+                emit(rom, 0x2000 | SUBROUTINE_ADDRESS);
+                break;
+        }
+        emitted++;
+    }
+    emit(rom, 0x1000 | LOOP_ADDRESS);
+}
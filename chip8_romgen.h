@@ -0,0 +1,73 @@
+/* Chip 8 Emulator  <chip8_romgen.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <vector>
+#include "chip8.h"
+
+#define ROMGEN_FAMILY_ALU           0           //8XY0-8XYE
+#define ROMGEN_FAMILY_LOAD          1           //6XNN, 7XNN
+#define ROMGEN_FAMILY_SKIP          2           //3XNN, 4XNN, 5XY0, 9XY0 taken as set by the branch pattern
+#define ROMGEN_FAMILY_MEMORY        3           //ANNN followed by FX55, FX65 or FX33 on the data area
+#define ROMGEN_FAMILY_DRAW          4           //FX29 followed by DXY5
+#define ROMGEN_FAMILY_RANDOM        5           //CXNN
+#define ROMGEN_FAMILY_CALL          6           //2NNN to a two instruction subroutine
+#define ROMGEN_FAMILY_COUNT         7
+
+#define ROMGEN_BRANCH_NEVER         0           //no skip is ever taken
+#define ROMGEN_BRANCH_ALWAYS        1           //every skip is taken
+#define ROMGEN_BRANCH_ALTERNATING   2           //skips are taken on every other pass over the loop
+#define ROMGEN_BRANCH_RANDOM        3           //each skip tests a fresh CXNN bit, nothing for a predictor to learn
+#define ROMGEN_BRANCH_COUNT         4
+
+#define ROMGEN_DEFAULT_LENGTH       256         //instructions in the loop body
+#define ROMGEN_MAX_LENGTH           960         //keeps the code below the data area
+#define ROMGEN_DATA_ADDRESS         0x800       //logical address FX55/FX65/FX33 work on, never overlaps the code
+
+/*
+ * Builds synthetic ROMs for benchmarking: a short prologue, a loop body of randomly chosen instructions drawn
+ * from the weighted families above, a jump back to the top of the loop and the subroutine CALL targets.  Every
+ * generated ROM runs forever without touching an invalid opcode, and the same options and seed always produce
+ * the same bytes, so results stay comparable across commits.
+ */
+class CHIP8_ROM_GENERATOR
+{
+    public:
+    CHIP8_ROM_GENERATOR();
+
+    void setWeight(unsigned int family, unsigned int weight);
+    int setMix(const char *mix);                //"alu=60,load=20,skip=10,..." unnamed families keep their weight
+    int setBranchPattern(const char *pattern);  //never, always, alternating or random
+    void setBranchPattern(unsigned int pattern);
+    void setLength(unsigned int instructions);  //clamped to 1..ROMGEN_MAX_LENGTH
+    void setSeed(unsigned long long seed);
+    void generate(std::vector<unsigned char> &rom);     //replaces rom with the program bytes (load at BASE_RAM_OFFSET)
+
+    static const char* getFamilyName(unsigned int family);
+    static const char* getBranchPatternName(unsigned int pattern);
+
+    private:
+    void emit(std::vector<unsigned char> &rom, ushort opcode);
+    unsigned int nextRandom(unsigned int range);
+    unsigned int pickFamily();
+
+    unsigned int weights[ROMGEN_FAMILY_COUNT];
+    unsigned int branchPattern;
+    unsigned int length;
+    unsigned long long seed;
+    unsigned int rngState;
+};
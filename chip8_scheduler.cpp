@@ -0,0 +1,238 @@
+/* Chip 8 Emulator  <chip8_scheduler.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include "chip8_scheduler.h"
+#include "chip8_display.h"
+#include "chip8_audio.h"
+
+using namespace std;
+
+static unsigned long long scaleExact(unsigned long long value, unsigned long long numerator, unsigned long long denominator)
+{   //value * numerator / denominator without overflowing the product for any realistic run length
+    return (value / denominator) * numerator + (value % denominator) * numerator / denominator;
+}
+
+static unsigned long long timespecToNanoseconds(const struct timespec &time)
+{
+    return (unsigned long long) time.tv_sec * NANOSECONDS_PER_SECOND + time.tv_nsec;
+}
+
+CHIP8_SCHEDULER::CHIP8_SCHEDULER(CHIP8_EMULATOR &emulator) : emulator(emulator)
+{
+    cpuClock = DEFAULT_CPU_CLOCK;
+    realTime = false;
+    useBlocks = false;
+    tickHandler = NULL;
+    tickContext = NULL;
+    display = NULL;
+    audio = NULL;
+    instructions = 0;
+    frames = 0;
+    lateFrames = 0;
+    clockBaseInstruction = 0;
+    clockBaseFrame = 0;
+    clockBaseNanoseconds = 0;
+    scheduleFrame = 0;
+    scheduleStart.tv_sec = 0;
+    scheduleStart.tv_nsec = 0;
+    scheduleStarted = false;
+}
+
+void CHIP8_SCHEDULER::setClock(unsigned long instructionsPerSecond)
+{
+    if(instructionsPerSecond == 0)
+    {
+        return;
+    }
+    //the new rate counts from here, what already ran keeps the virtual time it had
+    clockBaseNanoseconds = getVirtualNanoseconds();
+    clockBaseInstruction = instructions;
+    clockBaseFrame = frames;
+    cpuClock = instructionsPerSecond;
+}
+
+void CHIP8_SCHEDULER::setRealTime(bool enabled)
+{
+    realTime = enabled;
+    scheduleStarted = false;    //the wall clock origin is taken again when the next frame starts
+}
+
+void CHIP8_SCHEDULER::setUseBlocks(bool enabled)
+{
+    useBlocks = enabled;
+}
+
+void CHIP8_SCHEDULER::setTimerTickHandler(TIMER_TICK_HANDLER handler, void *context)
+{
+    tickHandler = handler;
+    tickContext = context;
+}
+
+void CHIP8_SCHEDULER::setDisplay(CHIP8_TRIPLE_BUFFER *display)
+{
+    this -> display = display;
+}
+
+void CHIP8_SCHEDULER::setAudio(CHIP8_AUDIO_SYNTH *audio)
+{
+    this -> audio = audio;
+}
+
+unsigned long CHIP8_SCHEDULER::getClock()
+{
+    return cpuClock;
+}
+
+unsigned long long CHIP8_SCHEDULER::getInstructionCount()
+{
+    return instructions;
+}
+
+unsigned long long CHIP8_SCHEDULER::getFrameCount()
+{
+    return frames;
+}
+
+unsigned long long CHIP8_SCHEDULER::getVirtualNanoseconds()
+{
+    return clockBaseNanoseconds + scaleExact(instructions - clockBaseInstruction, NANOSECONDS_PER_SECOND, cpuClock);
+}
+
+unsigned long long CHIP8_SCHEDULER::getLateFrames()
+{
+    return lateFrames;
+}
+
+unsigned long long CHIP8_SCHEDULER::frameEndInstruction()
+{
+    //cumulative, so clocks that are not a multiple of 60 never drift: frames get floor or ceil of clock / 60
+    return clockBaseInstruction + scaleExact(frames - clockBaseFrame + 1, cpuClock, TIMER_FREQUENCY);
+}
+
+int CHIP8_SCHEDULER::run(unsigned long long budget, unsigned long long *executedCount)
+{
+    unsigned long long executed = 0;
+    int returnValue = STATUS_SUCCESS;
+    startSchedule();
+    while(executed < budget && returnValue == STATUS_SUCCESS)
+    {
+        unsigned long long ran = 0;
+        returnValue = runSlice(budget - executed, &ran);
+        executed += ran;
+    }
+    *executedCount = executed;
+    return returnValue;
+}
+
+int CHIP8_SCHEDULER::runFrame(unsigned long long *executedCount)
+{
+    unsigned long long executed = 0;
+    unsigned long long frame = frames;
+    int returnValue = STATUS_SUCCESS;
+    startSchedule();
+    while(frames == frame && returnValue == STATUS_SUCCESS)
+    {
+        unsigned long long ran = 0;
+        returnValue = runSlice((unsigned long long) -1, &ran);
+        executed += ran;
+    }
+    *executedCount = executed;
+    return returnValue;
+}
+
+int CHIP8_SCHEDULER::runSlice(unsigned long long budget, unsigned long long *executedCount)
+{
+    unsigned long long frameEnd = frameEndInstruction();
+    unsigned long long chunk = (frameEnd > instructions) ? frameEnd - instructions : 0;   //0 when blocks overran a whole frame
+    if(chunk > budget)
+    {
+        chunk = budget;
+    }
+
+    unsigned long ran = 0;
+    int returnValue = STATUS_SUCCESS;
+    if(chunk > 0)
+    {
+        returnValue = useBlocks ? emulator.runBlocks(chunk, &ran) : emulator.runInstructions(chunk, &ran);
+    }
+    instructions += ran;
+    if(instructions >= frameEnd)
+    {
+        endFrame();
+    }
+    *executedCount = ran;
+    return returnValue;
+}
+
+void CHIP8_SCHEDULER::startSchedule()
+{
+    if(realTime && !scheduleStarted)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &scheduleStart);
+        scheduleFrame = frames;
+        scheduleStarted = true;
+    }
+}
+
+void CHIP8_SCHEDULER::endFrame()
+{
+    if(display != NULL)
+    {   //the picture the frame ends on, before the timers move
+        display->publish(emulator, frames);
+    }
+    if(audio != NULL)
+    {   //the frame sounded with the timer it ran with, the tick below belongs to the next one
+        audio->renderFrame(emulator);
+    }
+    //timers change only at frame boundaries, in virtual time, whatever the wall clock is doing
+    if(tickHandler != NULL)
+    {
+        tickHandler(emulator, instructions, tickContext);
+    }
+    else
+    {
+        emulator.tickTimers();
+    }
+    frames++;
+
+    if(!realTime)
+    {
+        return;
+    }
+    //deadlines are computed from the origin every frame rather than accumulated, so rounding never builds up
+    unsigned long long deadline = timespecToNanoseconds(scheduleStart) + scaleExact(frames - scheduleFrame, NANOSECONDS_PER_SECOND, TIMER_FREQUENCY);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(timespecToNanoseconds(now) >= deadline)
+    {
+        lateFrames++;
+        if(timespecToNanoseconds(now) - deadline > MAX_FRAME_LAG * NANOSECONDS_PER_SECOND / TIMER_FREQUENCY)
+        {   //stalled (debugger, suspended process...), start a fresh schedule instead of running frames flat out
+            scheduleStart = now;
+            scheduleFrame = frames;
+        }
+        return;
+    }
+
+    struct timespec wake;
+    wake.tv_sec = deadline / NANOSECONDS_PER_SECOND;
+    wake.tv_nsec = deadline % NANOSECONDS_PER_SECOND;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+    {   //a signal woke us early, the absolute deadline is still right
+    }
+}
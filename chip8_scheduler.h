@@ -0,0 +1,81 @@
+/* Chip 8 Emulator  <chip8_scheduler.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <ctime>
+#include "chip8.h"
+
+#define DEFAULT_CPU_CLOCK           600         //instructions per second of virtual time, 10 per frame
+#define NANOSECONDS_PER_SECOND      1000000000ULL
+#define MAX_FRAME_LAG               6           //real time: this many frames behind and the schedule restarts from now instead of bursting to catch up
+
+class CHIP8_TRIPLE_BUFFER;
+class CHIP8_AUDIO_SYNTH;
+
+typedef void (*TIMER_TICK_HANDLER)(CHIP8_EMULATOR &emulator, unsigned long long instruction, void *context);
+
+/*
+ * Splits execution into 60hz frames of virtual time.  Frame k ends after exactly (k + 1) * clock / 60 instructions
+ * counted from the start, so a clock that is not a multiple of 60 spreads the remainder over the frames without
+ * drifting, and the delay/sound timers tick once at every frame boundary.  In real time mode the end of frame k is
+ * also a deadline on CLOCK_MONOTONIC, the thread sleeps until it with clock_nanosleep(TIMER_ABSTIME).  Otherwise
+ * frames run back to back and only the virtual clock advances.
+ */
+class CHIP8_SCHEDULER
+{
+    public:
+    CHIP8_SCHEDULER(CHIP8_EMULATOR &emulator);
+
+    void setClock(unsigned long instructionsPerSecond); //0 is ignored
+    void setRealTime(bool enabled);                     //pace frames against the wall clock
+    void setUseBlocks(bool enabled);                    //run translated blocks (they may overrun a frame by part of a block)
+    void setTimerTickHandler(TIMER_TICK_HANDLER handler, void *context);  //replaces the plain tickTimers() at frame boundaries
+    void setDisplay(CHIP8_TRIPLE_BUFFER *display);      //publish the display at every frame boundary it changed in (NULL = off)
+    void setAudio(CHIP8_AUDIO_SYNTH *audio);            //render a frame of samples at every frame boundary (NULL = off)
+    int run(unsigned long long budget, unsigned long long *executedCount);    //runs budget instructions, stops early on an error
+    int runFrame(unsigned long long *executedCount);    //runs to the end of the current frame
+
+    unsigned long getClock();
+    unsigned long long getInstructionCount();           //instructions executed under this scheduler
+    unsigned long long getFrameCount();                 //frame boundaries passed (= timer ticks)
+    unsigned long long getVirtualNanoseconds();         //virtual time of the next instruction
+    unsigned long long getLateFrames();                 //real time: frames that finished after their deadline
+
+    private:
+    int runSlice(unsigned long long budget, unsigned long long *executedCount);
+    void startSchedule();
+    void endFrame();
+    unsigned long long frameEndInstruction();           //instruction count at which the current frame ends
+
+    CHIP8_EMULATOR &emulator;
+    unsigned long cpuClock;                             //instructions per second of virtual time
+    bool realTime;
+    bool useBlocks;
+    TIMER_TICK_HANDLER tickHandler;
+    void *tickContext;
+    CHIP8_TRIPLE_BUFFER *display;
+    CHIP8_AUDIO_SYNTH *audio;
+    unsigned long long instructions;
+    unsigned long long frames;
+    unsigned long long lateFrames;
+    unsigned long long clockBaseInstruction;            //instruction count when the clock was last set, frames are counted from here
+    unsigned long long clockBaseFrame;
+    unsigned long long clockBaseNanoseconds;            //virtual time at that point
+    unsigned long long scheduleFrame;                   //frames completed when the wall clock origin was taken
+    struct timespec scheduleStart;                      //CLOCK_MONOTONIC wall clock origin, frame deadlines are exact offsets from it
+    bool scheduleStarted;
+};
@@ -0,0 +1,464 @@
+/* Chip 8 Emulator  <chip8_session.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "chip8_input.h"
+#include "chip8_rom_cache.h"
+#include "chip8_session.h"
+
+using namespace std;
+
+int SESSION_WAIT::await_resume() noexcept
+{
+    return session->event;
+}
+
+CHIP8_SESSION::CHIP8_SESSION(unsigned int sessionId, const SESSION_CONFIG &config) : scheduler(emulator)
+{
+    this -> sessionId = sessionId;
+    this -> config = config;
+    emulator.initEmulator();
+    emulator.seedRNG(config.seed);
+    emulator.setPlatform(config.platform);
+    emulator.setQuirks(config.quirks);
+    scheduler.setClock(config.clock);
+    event = SESSION_EVENT_FRAME;
+    exitReason = SESSION_EXIT_STOPPED;
+    status = STATUS_SUCCESS;
+    quotaCredit = 0;
+    throttledFrames = 0;
+    cpuNanoseconds = 0;
+    inputLength = 0;
+    inputOpen = config.inputFd >= 0;
+    liveKeys = 0;
+    tappedKeys = 0;
+    task = body();      //last, the body runs up to its first co_await right away
+}
+
+CHIP8_SESSION::~CHIP8_SESSION()
+{
+    task.handle.destroy();
+}
+
+int CHIP8_SESSION::loadROM(const char *romFilename)
+{
+    shared_ptr<const CHIP8_ROM_IMAGE> image;
+    int returnValue = CHIP8_ROM_CACHE::getInstance().getROM(romFilename, image);
+    if(returnValue == STATUS_SUCCESS)
+    {
+        returnValue = emulator.loadROM(*image);
+    }
+    return returnValue;
+}
+
+void CHIP8_SESSION::getResult(SESSION_RESULT &result)
+{
+    result.sessionId = sessionId;
+    result.exitReason = exitReason;
+    result.status = status;
+    result.frames = scheduler.getFrameCount();
+    result.cycles = scheduler.getInstructionCount();
+    result.throttledFrames = throttledFrames;
+    result.cpuNanoseconds = cpuNanoseconds;
+    result.stateHash = emulator.getStateHash();
+}
+
+SESSION_TASK CHIP8_SESSION::body()
+{
+    while(true)
+    {
+        int event = co_await nextEvent();
+        if(event == SESSION_EVENT_STOP)
+        {
+            break;
+        }
+        if(event == SESSION_EVENT_INPUT)
+        {
+            inputOpen = readInput();
+            continue;
+        }
+
+        emulator.setKeyState(liveKeys | tappedKeys);
+        tappedKeys = 0;
+        unsigned long long executed = 0;
+        status = scheduler.runFrame(&executed);    //timers tick at its end
+        if(status == STATUS_PROGRAM_EXIT)
+        {
+            exitReason = SESSION_EXIT_PROGRAM;
+            break;
+        }
+        if(status != STATUS_SUCCESS)
+        {
+            exitReason = SESSION_EXIT_ERROR;
+            break;
+        }
+        if(config.frameLimit > 0 && scheduler.getFrameCount() >= config.frameLimit)
+        {
+            exitReason = SESSION_EXIT_FRAMES;
+            break;
+        }
+    }
+}
+
+SESSION_WAIT CHIP8_SESSION::nextEvent()
+{
+    return SESSION_WAIT { this };
+}
+
+bool CHIP8_SESSION::readInput()
+{
+    char text[256];
+    ssize_t length = read(config.inputFd, text, sizeof(text));
+    if(length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {   //closed, the session carries on with the keys it last had
+        return false;
+    }
+    for(ssize_t c = 0; c < length; c++)
+    {
+        if(text[c] != '\n')
+        {   //an overlong line is cut short and then fails to parse
+            if(inputLength < SESSION_INPUT_LINE - 1)
+            {
+                inputLine[inputLength++] = text[c];
+            }
+            continue;
+        }
+        inputLine[inputLength] = '\0';
+        inputLength = 0;
+        KEY_EVENT keyEvent;
+        if(CHIP8_KEYPAD::parseLine(inputLine, keyEvent))
+        {   //sessions are live, a frame number is ignored
+            liveKeys = keyEvent.keys;
+            tappedKeys |= keyEvent.keys;
+        }
+    }
+    return true;
+}
+
+bool CHIP8_SESSION::resume(int event)
+{
+    this -> event = event;
+    task.handle.resume();
+    return !task.handle.done();
+}
+
+CHIP8_SESSION_EXECUTOR::CHIP8_SESSION_EXECUTOR(unsigned int threadCount)
+{
+    if(threadCount == 0)
+    {
+        threadCount = thread::hardware_concurrency();
+        if(threadCount == 0)
+        {   //not computable on this platform
+            threadCount = 1;
+        }
+    }
+    this -> threadCount = threadCount;
+    stopping.store(true);   //until start()
+    nextSessionId.store(0);
+    liveSessions.store(0);
+    lateTicks.store(0);
+    resultCallback = NULL;
+    resultContext = NULL;
+}
+
+CHIP8_SESSION_EXECUTOR::~CHIP8_SESSION_EXECUTOR()
+{
+    stop();
+}
+
+int CHIP8_SESSION_EXECUTOR::start()
+{
+    if(!workers.empty())
+    {
+        return STATUS_SUCCESS;
+    }
+    struct itimerspec period;
+    period.it_interval.tv_sec = 0;
+    period.it_interval.tv_nsec = NANOSECONDS_PER_SECOND / TIMER_FREQUENCY;
+    period.it_value = period.it_interval;
+    for(unsigned int w = 0; w < threadCount; w++)
+    {
+        WORKER *worker = new WORKER();
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        worker->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        worker->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        worker->nextStart = 0;
+        workers.push_back(worker);
+
+        struct epoll_event timerEvent = { EPOLLIN, { &worker->timerFd } };
+        struct epoll_event wakeEvent = { EPOLLIN, { &worker->wakeFd } };
+        if(worker->epollFd < 0 || worker->timerFd < 0 || worker->wakeFd < 0
+           || epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->timerFd, &timerEvent) != 0
+           || epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->wakeFd, &wakeEvent) != 0
+           || timerfd_settime(worker->timerFd, 0, &period, NULL) != 0)
+        {
+            releaseWorkers();
+            return ERR_EXECUTOR_RESOURCES;
+        }
+    }
+    stopping.store(false);
+    for(unsigned int w = 0; w < threadCount; w++)
+    {
+        workers[w]->thread = thread(&CHIP8_SESSION_EXECUTOR::workerLoop, this, workers[w]);
+    }
+    return STATUS_SUCCESS;
+}
+
+int CHIP8_SESSION_EXECUTOR::addSession(const char *romFilename, const SESSION_CONFIG &config)
+{
+    if(stopping.load())
+    {
+        return ERR_EXECUTOR_STOPPED;
+    }
+    unsigned int sessionId = nextSessionId.fetch_add(1);
+    CHIP8_SESSION *session = new CHIP8_SESSION(sessionId, config);
+    int returnValue = session->loadROM(romFilename);
+    if(returnValue != STATUS_SUCCESS)
+    {
+        delete session;
+        return returnValue;
+    }
+
+    WORKER *worker = workers[sessionId % threadCount];
+    liveSessions++;
+    {
+        lock_guard<mutex> guard(worker->lock);
+        worker->incoming.push_back(session);
+    }
+    uint64_t wake = 1;
+    write(worker->wakeFd, &wake, sizeof(wake));
+    return sessionId;
+}
+
+void CHIP8_SESSION_EXECUTOR::stop()
+{
+    if(workers.empty())
+    {
+        return;
+    }
+    stopping.store(true);
+    for(unsigned int w = 0; w < workers.size(); w++)
+    {
+        uint64_t wake = 1;
+        write(workers[w]->wakeFd, &wake, sizeof(wake));
+    }
+    for(unsigned int w = 0; w < workers.size(); w++)
+    {
+        workers[w]->thread.join();
+    }
+    releaseWorkers();
+}
+
+void CHIP8_SESSION_EXECUTOR::releaseWorkers()
+{
+    for(unsigned int w = 0; w < workers.size(); w++)
+    {
+        WORKER *worker = workers[w];
+        if(worker->epollFd >= 0)
+        {
+            close(worker->epollFd);
+        }
+        if(worker->timerFd >= 0)
+        {
+            close(worker->timerFd);
+        }
+        if(worker->wakeFd >= 0)
+        {
+            close(worker->wakeFd);
+        }
+        delete worker;
+    }
+    workers.clear();
+}
+
+void CHIP8_SESSION_EXECUTOR::setResultCallback(SESSION_RESULT_CALLBACK onResult, void *context)
+{
+    resultCallback = onResult;
+    resultContext = context;
+}
+
+unsigned int CHIP8_SESSION_EXECUTOR::getThreadCount()
+{
+    return threadCount;
+}
+
+unsigned int CHIP8_SESSION_EXECUTOR::getLiveSessions()
+{
+    return liveSessions.load();
+}
+
+unsigned long long CHIP8_SESSION_EXECUTOR::getLateTicks()
+{
+    return lateTicks.load();
+}
+
+void CHIP8_SESSION_EXECUTOR::workerLoop(WORKER *worker)
+{
+    struct epoll_event events[SESSION_EPOLL_EVENTS];
+    while(!stopping.load())
+    {
+        int count = epoll_wait(worker->epollFd, events, SESSION_EPOLL_EVENTS, -1);
+        for(int e = 0; e < count; e++)
+        {
+            void *source = events[e].data.ptr;
+            if(source == &worker->timerFd)
+            {
+                uint64_t expirations = 0;
+                if(read(worker->timerFd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 1)
+                {   //the worker fell behind, the missed ticks are not made up so sessions slow down instead of bursting
+                    lateTicks += expirations - 1;
+                }
+                runTick(worker);
+            }
+            else if(source == &worker->wakeFd)
+            {
+                uint64_t wakes = 0;
+                read(worker->wakeFd, &wakes, sizeof(wakes));
+                adoptSessions(worker);
+            }
+            else
+            {
+                CHIP8_SESSION *session = (CHIP8_SESSION *) source;
+                if(!session->task.handle.done())
+                {
+                    resumeSession(worker, session, SESSION_EVENT_INPUT);
+                }
+            }
+        }
+        sweepSessions(worker);
+    }
+
+    adoptSessions(worker);      //anything added while stop() was on its way
+    for(unsigned int s = 0; s < worker->sessions.size(); s++)
+    {
+        if(!worker->sessions[s]->task.handle.done())
+        {
+            resumeSession(worker, worker->sessions[s], SESSION_EVENT_STOP);
+        }
+    }
+    sweepSessions(worker);
+}
+
+void CHIP8_SESSION_EXECUTOR::adoptSessions(WORKER *worker)
+{
+    vector<CHIP8_SESSION*> adopted;
+    {
+        lock_guard<mutex> guard(worker->lock);
+        adopted.swap(worker->incoming);
+    }
+    for(unsigned int s = 0; s < adopted.size(); s++)
+    {
+        CHIP8_SESSION *session = adopted[s];
+        struct epoll_event inputEvent = { EPOLLIN, { session } };
+        if(session->inputOpen && epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, session->config.inputFd, &inputEvent) != 0)
+        {   //not pollable, the session runs without input
+            session->inputOpen = false;
+        }
+        worker->sessions.push_back(session);
+    }
+}
+
+void CHIP8_SESSION_EXECUTOR::runTick(WORKER *worker)
+{
+    unsigned int count = worker->sessions.size();
+    if(count == 0)
+    {
+        return;
+    }
+    unsigned int first = worker->nextStart % count;
+    worker->nextStart = first + 1;
+    for(unsigned int s = 0; s < count; s++)
+    {
+        CHIP8_SESSION *session = worker->sessions[(first + s) % count];
+        if(session->task.handle.done())
+        {
+            continue;
+        }
+        if(session->config.quotaPercent > 0)
+        {   //token bucket in nanoseconds: a frame's share of the quota per tick, a few frames of it can be saved up
+            long long allowance = (long long) (session->config.quotaPercent * NANOSECONDS_PER_SECOND / TIMER_FREQUENCY / 100);
+            session->quotaCredit += allowance;
+            if(session->quotaCredit > allowance * SESSION_QUOTA_BURST)
+            {
+                session->quotaCredit = allowance * SESSION_QUOTA_BURST;
+            }
+            if(session->quotaCredit < 0)
+            {
+                session->throttledFrames++;
+                continue;
+            }
+        }
+        resumeSession(worker, session, SESSION_EVENT_FRAME);
+    }
+}
+
+void CHIP8_SESSION_EXECUTOR::resumeSession(WORKER *worker, CHIP8_SESSION *session, int event)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool running = session->resume(event);
+    long long spent = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    session->cpuNanoseconds += spent;
+    session->quotaCredit -= spent;
+    if(!running)
+    {
+        retireSession(worker, session);
+    }
+    else if(event == SESSION_EVENT_INPUT && !session->inputOpen)
+    {
+        epoll_ctl(worker->epollFd, EPOLL_CTL_DEL, session->config.inputFd, NULL);
+    }
+}
+
+void CHIP8_SESSION_EXECUTOR::retireSession(WORKER *worker, CHIP8_SESSION *session)
+{
+    if(session->inputOpen)
+    {
+        epoll_ctl(worker->epollFd, EPOLL_CTL_DEL, session->config.inputFd, NULL);
+        session->inputOpen = false;
+    }
+    if(resultCallback != NULL)
+    {
+        SESSION_RESULT result;
+        session->getResult(result);
+        lock_guard<mutex> guard(resultLock);
+        resultCallback(result, resultContext);
+    }
+    liveSessions--;
+}
+
+void CHIP8_SESSION_EXECUTOR::sweepSessions(WORKER *worker)
+{
+    unsigned int kept = 0;
+    for(unsigned int s = 0; s < worker->sessions.size(); s++)
+    {
+        if(worker->sessions[s]->task.handle.done())
+        {
+            delete worker->sessions[s];
+        }
+        else
+        {
+            worker->sessions[kept++] = worker->sessions[s];
+        }
+    }
+    worker->sessions.resize(kept);
+}
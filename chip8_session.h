@@ -0,0 +1,190 @@
+/* Chip 8 Emulator  <chip8_session.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+#include "chip8_scheduler.h"
+
+#define ERR_EXECUTOR_RESOURCES      -70         //an epoll, timer or event descriptor could not be created
+#define ERR_EXECUTOR_STOPPED        -71         //addSession() before start() or after stop()
+
+#define SESSION_EVENT_FRAME     0           //the worker's 60hz tick came round and the quota allows a frame
+#define SESSION_EVENT_INPUT     1           //the input descriptor is readable
+#define SESSION_EVENT_STOP      2           //the executor is shutting down, the session returns
+
+#define SESSION_QUOTA_BURST     6           //frames of unused CPU quota a session may save up for a burst
+#define SESSION_INPUT_LINE      64          //longest "<keys>" line taken from a session's input
+#define SESSION_EPOLL_EVENTS    64          //events a worker takes from epoll at once
+
+#define SESSION_EXIT_STOPPED    0           //still running when the executor stopped
+#define SESSION_EXIT_PROGRAM    1           //00FD
+#define SESSION_EXIT_ERROR      2           //emulator returned an error (see SESSION_RESULT::status)
+#define SESSION_EXIT_FRAMES     3           //ran its frame limit
+
+struct SESSION_CONFIG
+{
+    unsigned int platform;                      //PLATFORM_*
+    unsigned int quirks;                        //QUIRK_* mask
+    unsigned long long seed;                    //RNG seed for CXNN
+    unsigned long clock;                        //instructions per second of virtual time, 0 = DEFAULT_CPU_CLOCK
+    unsigned int quotaPercent;                  //share of one core the session may use, 0 = no limit
+    unsigned long long frameLimit;              //frames to run, 0 = until the program exits or the executor stops
+    int inputFd;                                //non-blocking pipe or socket of "<keys>" lines, -1 = none (not closed by the session)
+};
+
+struct SESSION_RESULT
+{
+    unsigned int sessionId;                     //addSession() order
+    int exitReason;                             //one of SESSION_EXIT_*
+    int status;                                 //emulator status code that ended the run
+    unsigned long long frames;                  //frames run
+    unsigned long long cycles;                  //instructions executed
+    unsigned long long throttledFrames;         //ticks skipped because the session was over its quota
+    unsigned long long cpuNanoseconds;          //worker time spent running the session
+    unsigned long long stateHash;               //CHIP8_EMULATOR::getStateHash() at the end
+};
+
+typedef void (*SESSION_RESULT_CALLBACK)(const SESSION_RESULT &result, void *context);
+
+class CHIP8_SESSION;
+
+/*
+ * A session's body is a coroutine: it runs one frame of instructions, then co_awaits its next event.  The body runs
+ * up to its first co_await when it is created and stays suspended at the end, so the executor alone decides when
+ * it runs and when it is freed.
+ */
+struct SESSION_TASK
+{
+    struct promise_type
+    {
+        SESSION_TASK get_return_object() { return SESSION_TASK { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+struct SESSION_WAIT                             //co_await'ed by the body, yields to the worker until the next event
+{
+    CHIP8_SESSION *session;
+
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<>) noexcept {}
+    int await_resume() noexcept;                //the SESSION_EVENT_* it was resumed for
+};
+
+/*
+ * One interactive machine hosted by a CHIP8_SESSION_EXECUTOR.  Keys arriving on the input descriptor apply at
+ * the next frame; a key pressed and released between two frames is still held for one frame.
+ */
+class CHIP8_SESSION
+{
+    public:
+    CHIP8_SESSION(unsigned int sessionId, const SESSION_CONFIG &config);
+    ~CHIP8_SESSION();
+
+    int loadROM(const char *romFilename);       //through the process-wide ROM cache, sessions of one ROM share its pages
+    void getResult(SESSION_RESULT &result);
+
+    private:
+    friend class CHIP8_SESSION_EXECUTOR;
+    friend struct SESSION_WAIT;
+
+    SESSION_TASK body();
+    SESSION_WAIT nextEvent();
+    bool readInput();                           //false once the descriptor is closed or failed
+    bool resume(int event);                     //runs the body up to its next co_await, false once it has returned
+
+    unsigned int sessionId;
+    SESSION_CONFIG config;
+    CHIP8_EMULATOR emulator;
+    CHIP8_SCHEDULER scheduler;
+    SESSION_TASK task;
+    int event;                                  //what the body was last resumed for
+    int exitReason;
+    int status;
+    long long quotaCredit;                      //nanoseconds of CPU the session may still use, negative = in debt
+    unsigned long long throttledFrames;
+    unsigned long long cpuNanoseconds;
+    char inputLine[SESSION_INPUT_LINE];
+    unsigned int inputLength;
+    bool inputOpen;
+    ushort liveKeys;                            //keypad state from the last input line
+    ushort tappedKeys;                          //keys seen since the last frame
+};
+
+/*
+ * Multiplexes sessions over a few worker threads.  Each worker owns an epoll instance watching a 60hz timerfd,
+ * an eventfd for new sessions and shutdown, and the input descriptors of its sessions.  At every tick it resumes
+ * its sessions for one frame each, starting one further round each time so no session is always last; a session
+ * that has spent its CPU quota sits out ticks until its credit is positive again.  Sessions never block, so one
+ * thread can carry thousands of them and the tick rate, not the session count, sets how often each one runs.
+ */
+class CHIP8_SESSION_EXECUTOR
+{
+    public:
+    CHIP8_SESSION_EXECUTOR(unsigned int threadCount = 0);  //0 = one worker per hardware thread
+    ~CHIP8_SESSION_EXECUTOR();
+
+    int start();                                        //creates the workers, ERR_EXECUTOR_RESOURCES when a descriptor cannot be made
+    int addSession(const char *romFilename, const SESSION_CONFIG &config);   //any time after start(), returns the session id or an error (< 0)
+    void stop();                                        //ends every session (reporting it) and joins the workers
+    void setResultCallback(SESSION_RESULT_CALLBACK onResult, void *context);   //serialized, called as each session ends
+    unsigned int getThreadCount();
+    unsigned int getLiveSessions();
+    unsigned long long getLateTicks();                  //ticks a worker was too busy to take on time
+
+    private:
+    struct WORKER
+    {
+        int epollFd;
+        int timerFd;                                    //60hz frame tick
+        int wakeFd;                                     //eventfd, written by addSession() and stop()
+        std::thread thread;
+        std::mutex lock;                                //guards incoming
+        std::vector<CHIP8_SESSION*> incoming;           //added, not yet adopted by the worker
+        std::vector<CHIP8_SESSION*> sessions;           //worker thread only
+        unsigned int nextStart;                         //session resumed first at the next tick
+    };
+
+    void workerLoop(WORKER *worker);
+    void adoptSessions(WORKER *worker);
+    void runTick(WORKER *worker);
+    void resumeSession(WORKER *worker, CHIP8_SESSION *session, int event);  //charges the CPU used to the session's quota
+    void retireSession(WORKER *worker, CHIP8_SESSION *session);   //reports an ended session, it is freed by sweepSessions()
+    void sweepSessions(WORKER *worker);                 //after each batch of events, which may still name a retired session
+    void releaseWorkers();
+
+    unsigned int threadCount;
+    std::vector<WORKER*> workers;
+    std::atomic<bool> stopping;
+    std::atomic<unsigned int> nextSessionId;
+    std::atomic<unsigned int> liveSessions;
+    std::atomic<unsigned long long> lateTicks;
+    std::mutex resultLock;                              //serializes the result callback
+    SESSION_RESULT_CALLBACK resultCallback;
+    void *resultContext;
+};
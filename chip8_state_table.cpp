@@ -0,0 +1,52 @@
+/* Chip 8 Emulator  <chip8_state_table.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "chip8_state_table.h"
+
+using namespace std;
+
+bool CHIP8_STATE_TABLE::findOrInsert(unsigned long long key, const STATE_SIGHTING &sighting, STATE_SIGHTING *first)
+{
+    SHARD &shard = shards[key >> (64 - STATE_TABLE_SHARD_BITS)];
+    lock_guard<mutex> guard(shard.lock);
+    pair<unordered_map<unsigned long long, STATE_SIGHTING>::iterator, bool> found = shard.states.insert(make_pair(key, sighting));
+    if(!found.second)
+    {
+        *first = found.first->second;
+    }
+    return found.second;
+}
+
+unsigned long CHIP8_STATE_TABLE::getStateCount()
+{
+    unsigned long count = 0;
+    for(unsigned int s = 0; s < STATE_TABLE_SHARDS; s++)
+    {
+        lock_guard<mutex> guard(shards[s].lock);
+        count += shards[s].states.size();
+    }
+    return count;
+}
+
+void CHIP8_STATE_TABLE::clear()
+{
+    for(unsigned int s = 0; s < STATE_TABLE_SHARDS; s++)
+    {
+        lock_guard<mutex> guard(shards[s].lock);
+        shards[s].states.clear();
+    }
+}
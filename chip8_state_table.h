@@ -0,0 +1,52 @@
+/* Chip 8 Emulator  <chip8_state_table.h>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#define STATE_TABLE_SHARD_BITS  6
+#define STATE_TABLE_SHARDS      (1 << STATE_TABLE_SHARD_BITS)   //independently locked parts, picked by the top bits of a key
+
+struct STATE_SIGHTING                                   //where a machine state was first reached
+{
+    unsigned int jobId;
+    unsigned long cycle;                                //instructions the job had executed when it got there
+    unsigned long long stateHash;                       //CHIP8_EMULATOR::getStateHash() there, an independent check on a key match
+};
+
+/*
+ * Machine states (CHIP8_EMULATOR::getZobristHash() keys) reached by any of many concurrent runs.  The table is
+ * split into shards with a lock each, so threads only contend when their keys land in the same shard.  A key match
+ * is only a candidate: the caller compares the sightings' stateHash too before it treats two states as the same.
+ */
+class CHIP8_STATE_TABLE
+{
+    public:
+    bool findOrInsert(unsigned long long key, const STATE_SIGHTING &sighting, STATE_SIGHTING *first);  //true when the key was new, else *first is its first sighting
+    unsigned long getStateCount();
+    void clear();
+
+    private:
+    struct alignas(64) SHARD                            //a cache line apart, so one shard's lock does not bounce another's
+    {
+        std::mutex lock;
+        std::unordered_map<unsigned long long, STATE_SIGHTING> states;
+    };
+
+    SHARD shards[STATE_TABLE_SHARDS];
+};
@@ -1,46 +1,750 @@
-/* Chip 8 Emulator  <main.cpp>
-Copyright (C) <2018>  <Bandit>
-
-This program is free software: you can redistribute it and/or modify
-it under the terms of the GNU General Public License as published by
-the Free Software Foundation, either version 3 of the License, or
-(at your option) any later version.
-
-This program is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the GNU General Public License
-along with this program.  If not, see <https://www.gnu.org/licenses/>. 
-*/
-
-#include <iostream>
-// #include <atomic>
-#include "chip8.h"
-
-
-using namespace std;
-
-int main(int argc, char *argv[])
-{
-    // std::atomic<int> myVar;
-    // myVar = 0;
-    // char TESTFILENAME[] = "Breakout.ch8";
-    char TESTFILENAME[] = "test_vector.ch8";
-    CHIP8_EMULATOR emulator;
-    emulator.initEmulator();
-    if(emulator.loadROM(TESTFILENAME) != STATUS_SUCCESS)
-    {
-        return ERR_UNABLE_OPEN_FILE;
-    }
-    unsigned int emulatorCycleCnt = 0;
-    while(1)
-    {
-        ++emulatorCycleCnt;
-        emulator.emulatorTick();
-        cout << "Emulator Cycle Count: " << emulatorCycleCnt << endl;
-    }
-
-    return 0;
-}
\ No newline at end of file
+/* Chip 8 Emulator  <main.cpp>
+Copyright (C) <2018>  <Bandit>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include "chip8.h"
+#include "chip8_batch.h"
+#include "chip8_lockstep.h"
+#include "chip8_replay.h"
+#include "chip8_scheduler.h"
+#include "chip8_profile.h"
+#include "chip8_quirks.h"
+#include "chip8_display.h"
+#include "chip8_audio.h"
+#include "chip8_input.h"
+#include "chip8_session.h"
+#include "chip8_rom_cache.h"
+#include "chip8_analyzer.h"
+
+#define TIME_CHECK_INTERVAL     (1UL << 16)     //instructions run between wall clock checks in headless mode
+#define DEFAULT_SESSION_SECONDS 10.0            //how long --sessions runs without --seconds
+
+using namespace std;
+
+static void printUsage(const char *programName)
+{
+    cerr << "Usage: " << programName << " [options] [rom.ch8]" << endl
+         << "  --headless        run without per-cycle output and print a summary at the end" << endl
+         << "  --cycles=N        stop after N instructions (headless)" << endl
+         << "  --seconds=S       stop after S seconds of wall clock time (headless)" << endl
+         << "  --seed=N          seed for CXNN (default: 0 headless, the clock in interactive runs)" << endl
+         << "  --clock=HZ        instructions per second of virtual time (default " << DEFAULT_CPU_CLOCK << "), timers tick every 1/60 s" << endl
+         << "  --realtime        pace a headless run against the wall clock (always on without --headless)" << endl
+         << "  --no-idle-skip    run idle loops instruction by instruction instead of fast-forwarding them" << endl
+         << "  --predecode       analyze the ROM first and decode every reachable instruction before the run" << endl
+         << "  --platform=P      machine to emulate: chip8 (default), schip or xochip" << endl
+         << "  --quirks=Q        interpreter quirks: default, vip, chip48, schip, xochip or a list of shift,index,index+1,jump,vf-reset" << endl
+         << "                    (default: the platform's own, see README)" << endl
+         << "  --quirk-db=FILE   pick the quirks by ROM hash from FILE (<hash> <quirks> [title] per line), --quirks overrides it" << endl
+         << "  --profile=PREFIX  write a guest code profile to PREFIX.json and PREFIX.folded (PROFILE=1 builds)" << endl
+         << "  --profile-sample=N  record every Nth instruction instead of all of them (skips and calls stay exact)" << endl
+         << "  --dump-frames=PREFIX  write every displayed frame to PREFIX_<frame>.ppm from a separate thread" << endl
+         << "  --audio=FILE      write the beeper (XO-CHIP: the audio pattern) to FILE as a 16 bit mono WAV from a separate thread" << endl
+         << "  --blocks          execute translated blocks instead of single instructions" << endl
+         << "  --diff            compare translated blocks against the interpreter (implies --blocks)" << endl
+         << "  --batch=FILE      run every job in a manifest (<rom> [seed] [cycles] per line) on all cores" << endl
+         << "  --dedup           share the states --batch jobs reach, so a job that gets to one already run from reuses its result" << endl
+         << "  --threads=N       worker threads for --batch and --sessions (default: one per hardware thread)" << endl
+         << "  --lockstep=N      run N copies of the ROM (seeds 0..N-1) in lockstep for --cycles steps" << endl
+         << "  --sessions=N      host N interactive copies of the ROM (seeds 0..N-1) at 60 frames a second for --seconds" << endl
+         << "  --session-quota=PCT  share of one core each session may use (default: no limit)" << endl
+         << "  --input=SOURCE    keypad input: terminal, script:FILE (<frame> <keys> lines) or fd:N ([frame] <keys> lines)" << endl
+         << "  --record=FILE     log keys and timer ticks of a headless run so it can be replayed" << endl
+         << "  --replay=FILE     rerun a recorded log (no ROM needed) and check the final state" << endl;
+}
+
+static int runLockstep(char romFilename[MAX_FILENAME_LEN], unsigned int machineCount, unsigned long steps)
+{
+    CHIP8_LOCKSTEP machines(machineCount);
+    for(unsigned int m = 0; m < machineCount; m++)
+    {
+        machines.seedRNG(m, m);
+    }
+    int returnValue = machines.loadROM(romFilename);
+    if(returnValue != STATUS_SUCCESS)
+    {
+        return returnValue;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    machines.run(steps);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    unsigned long executed = 0;
+    cout << "# machine status cycles state_hash" << endl;
+    for(unsigned int m = 0; m < machineCount; m++)
+    {
+        executed += machines.getCycles(m);
+        cout << m << ' ' << machines.getStatus(m) << ' ' << machines.getCycles(m)
+             << " 0x" << hex << machines.getStateHash(m) << dec << endl;
+    }
+    cout << "Instructions executed: " << executed << endl;
+    cout << "Elapsed seconds: " << elapsed << endl;
+    cout << "MIPS: " << (elapsed > 0.0 ? executed / elapsed / 1e6 : 0.0) << endl;
+    cout << "Group steps: " << machines.getGroupSteps() << endl;
+    cout << "Scalar steps: " << machines.getScalarSteps() << endl;
+    cout << "Private pages: " << machines.getPrivatePageCount() << endl;
+    return STATUS_SUCCESS;
+}
+
+static void printBatchResult(const BATCH_RESULT &result, void *context)
+{
+    static const char *exitReasons[] = { "budget", "error", "load_failed" };
+    cout << result.jobId << ' ' << result.romPath << ' ' << result.seed << ' '
+         << exitReasons[result.exitReason] << ' ' << result.status << ' '
+         << result.cycles << " 0x" << hex << result.stateHash << dec << endl;
+}
+
+static int runBatch(const char *manifest, unsigned int threadCount, bool useBlocks, bool deduplicate)
+{
+    CHIP8_BATCH_RUNNER runner(threadCount);
+    int returnValue = runner.loadManifest(manifest);
+    if(returnValue != STATUS_SUCCESS)
+    {
+        return returnValue;
+    }
+    runner.setUseBlocks(useBlocks);
+    runner.setDeduplicate(deduplicate);
+    cout << "# job rom seed exit status cycles state_hash (" << runner.getThreadCount() << " threads)" << endl;
+    returnValue = runner.run(printBatchResult, NULL);
+    if(deduplicate)
+    {
+        cout << "# " << runner.getReusedResultCount() << " results reused, " << runner.getSkippedCycleCount()
+             << " instructions skipped, " << runner.getStateCount() << " states" << endl;
+    }
+    return returnValue;
+}
+
+struct SESSION_TOTALS
+{
+    unsigned long long frames;
+    unsigned long long cycles;
+    unsigned long long throttledFrames;
+};
+
+static void printSessionResult(const SESSION_RESULT &result, void *context)
+{
+    static const char *exitReasons[] = { "stopped", "program_exit", "error", "frames" };
+    SESSION_TOTALS *totals = (SESSION_TOTALS *) context;
+    totals->frames += result.frames;
+    totals->cycles += result.cycles;
+    totals->throttledFrames += result.throttledFrames;
+    cout << result.sessionId << ' ' << exitReasons[result.exitReason] << ' ' << result.status << ' '
+         << result.frames << ' ' << result.cycles << ' ' << result.throttledFrames << ' '
+         << result.cpuNanoseconds / 1000 << " 0x" << hex << result.stateHash << dec << endl;
+}
+
+static int runSessions(const char *romFilename, unsigned int sessionCount, unsigned int threadCount, const SESSION_CONFIG &config, double seconds)
+{
+    CHIP8_SESSION_EXECUTOR executor(threadCount);
+    SESSION_TOTALS totals = { 0, 0, 0 };
+    executor.setResultCallback(printSessionResult, &totals);
+    int returnValue = executor.start();
+    if(returnValue != STATUS_SUCCESS)
+    {
+        cerr << "Unable to start the session executor!" << endl;
+        return returnValue;
+    }
+    cout << "# session exit status frames cycles throttled cpu_us state_hash (" << executor.getThreadCount() << " threads)" << endl;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    SESSION_CONFIG sessionConfig = config;
+    for(unsigned int s = 0; s < sessionCount; s++)
+    {
+        sessionConfig.seed = s;
+        returnValue = executor.addSession(romFilename, sessionConfig);
+        if(returnValue < 0)
+        {
+            cerr << "Unable to load ROM for session " << s << "!" << endl;
+            executor.stop();
+            return returnValue;
+        }
+    }
+    double elapsed = 0.0;
+    while(executor.getLiveSessions() > 0 && elapsed < seconds)
+    {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    executor.stop();
+
+    cout << "Sessions: " << sessionCount << endl;
+    cout << "Elapsed seconds: " << elapsed << endl;
+    cout << "Frames: " << totals.frames << " (" << (elapsed > 0.0 ? totals.frames / elapsed : 0.0) << " per second)" << endl;
+    cout << "Instructions executed: " << totals.cycles << endl;
+    cout << "Throttled frames: " << totals.throttledFrames << endl;
+    cout << "Late ticks: " << executor.getLateTicks() << endl;
+    return STATUS_SUCCESS;
+}
+
+static void printSummary(CHIP8_EMULATOR &emulator, const char *romName, const char *exitReason, int returnValue, unsigned long executed, double elapsed)
+{
+    cout << "ROM: " << romName << endl;
+    cout << "Exit reason: " << exitReason << " (" << returnValue << ")" << endl;
+    if(returnValue == ERR_INVALID_OPCODE)
+    {
+        cout << "Invalid opcode: 0x" << hex << emulator.getInvalidOpcode() << dec << endl;
+    }
+    cout << "Instructions executed: " << executed << endl;
+    cout << "Elapsed seconds: " << elapsed << endl;
+    cout << "MIPS: " << (elapsed > 0.0 ? executed / elapsed / 1e6 : 0.0) << endl;
+    cout << "Register hash: 0x" << hex << emulator.getRegisterHash() << dec << endl;
+    cout << "Framebuffer hash: 0x" << hex << emulator.getGraphicsHash() << dec << endl;
+    cout << "State hash: 0x" << hex << emulator.getStateHash() << dec << endl;    //what --batch and --lockstep print
+}
+
+struct FRAME_INPUT                              //what reaches the machine from the host at a frame boundary
+{
+    CHIP8_RECORDER *recorder;                   //logs it when recording, applies it either way
+    CHIP8_KEYPAD *keypad;                       //NULL without --input
+};
+
+static void frameBoundary(CHIP8_EMULATOR &emulator, unsigned long long instruction, void *context)
+{
+    FRAME_INPUT *input = (FRAME_INPUT *) context;
+    ushort keys;
+    if(input->keypad != NULL && input->keypad->update(&keys))
+    {   //never blocks, the input thread has already queued whatever arrived during the frame
+        input->recorder->setKeyState(emulator, keys, instruction);
+    }
+    input->recorder->tickTimers(emulator, instruction);
+}
+
+static int runHeadless(CHIP8_EMULATOR &emulator, CHIP8_SCHEDULER &scheduler, CHIP8_KEYPAD *keypad, const char *romName, unsigned long cycleBudget, double secondsBudget, bool realTime, const char *recordFilename)
+{
+    const char *exitReason = "cycle budget reached";
+    unsigned long executed = 0;
+    int returnValue = STATUS_SUCCESS;
+    CHIP8_RECORDER recorder;    //every key change and timer tick goes through here, logged when recording
+    if(recordFilename != NULL)
+    {
+        returnValue = recorder.open(recordFilename, emulator);
+        if(returnValue != STATUS_SUCCESS)
+        {
+            return returnValue;
+        }
+    }
+    FRAME_INPUT input = { &recorder, keypad };
+    scheduler.setTimerTickHandler(frameBoundary, &input);
+    //paced runs check the wall clock every frame, flat out runs only every TIME_CHECK_INTERVAL instructions
+    unsigned long checkInterval = realTime ? scheduler.getClock() / TIMER_FREQUENCY + 1 : TIME_CHECK_INTERVAL;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double elapsed = 0.0;
+
+    while(executed < cycleBudget)
+    {
+        unsigned long chunk = cycleBudget - executed;
+        if(chunk > checkInterval)
+        {
+            chunk = checkInterval;
+        }
+        unsigned long long chunkExecuted = 0;
+        returnValue = scheduler.run(chunk, &chunkExecuted);    //timers tick at frame boundaries of virtual time
+        executed += chunkExecuted;
+
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(returnValue == STATUS_PROGRAM_EXIT)
+        {   //00FD, the ROM is done
+            exitReason = "program exited";
+            break;
+        }
+        if(returnValue != STATUS_SUCCESS)
+        {
+            exitReason = "emulator error";
+            break;
+        }
+        if(secondsBudget > 0.0 && elapsed >= secondsBudget)
+        {
+            exitReason = "time budget reached";
+            break;
+        }
+    }
+
+    if(recorder.isOpen() && recorder.close(emulator, executed) != STATUS_SUCCESS)
+    {
+        cerr << "Unable to write replay log!" << endl;
+    }
+    printSummary(emulator, romName, exitReason, returnValue, executed, elapsed);
+    cout << "Frames: " << scheduler.getFrameCount() << endl;
+    cout << "Virtual seconds: " << scheduler.getVirtualNanoseconds() / 1e9 << endl;
+    cout << "Platform: " << getPlatformName(emulator.getPlatform()) << endl;
+    cout << "Quirks: " << getQuirksName(emulator.getQuirks()) << endl;
+    cout << "Idle loop skips: " << emulator.getIdleSkipCount() << endl;
+    cout << "Instructions elided: " << emulator.getElidedInstructionCount() << " ("
+         << (executed > 0 ? 100.0 * emulator.getElidedInstructionCount() / executed : 0.0) << "%)" << endl;
+    if(realTime)
+    {
+        cout << "Late frames: " << scheduler.getLateFrames() << endl;
+    }
+    return (returnValue == STATUS_PROGRAM_EXIT) ? STATUS_SUCCESS : returnValue;
+}
+
+static int writeProfile(CHIP8_PROFILER &profiler, const char *prefix)
+{
+    int returnValue = profiler.writeJSON((string(prefix) + ".json").c_str());
+    if(returnValue == STATUS_SUCCESS)
+    {
+        returnValue = profiler.writeFolded((string(prefix) + ".folded").c_str());
+    }
+    if(returnValue == STATUS_SUCCESS)
+    {
+        cout << "Profile written to " << prefix << ".json and " << prefix << ".folded" << endl;
+    }
+    return returnValue;
+}
+
+static int selectQuirks(CHIP8_EMULATOR &emulator, const char *romFilename, const char *databaseFilename, bool quirksGiven, unsigned int quirks)
+{
+    //settled once per ROM load, the decoder builds every handler for these quirks from here on
+    if(databaseFilename != NULL && !quirksGiven)
+    {
+        CHIP8_QUIRK_DATABASE database;
+        int returnValue = database.load(databaseFilename);
+        if(returnValue != STATUS_SUCCESS)
+        {
+            return returnValue;
+        }
+        shared_ptr<const CHIP8_ROM_IMAGE> image;    //already cached by loadROM(), this only looks it up
+        returnValue = CHIP8_ROM_CACHE::getInstance().getROM(romFilename, image);
+        if(returnValue != STATUS_SUCCESS)
+        {
+            return returnValue;
+        }
+        if(!database.lookup(image->contentHash, &quirks))
+        {
+            cerr << "ROM hash 0x" << hex << image->contentHash << dec << " is not in the quirk database, using "
+                 << getQuirksName(quirks) << " quirks" << endl;
+        }
+    }
+    return emulator.setQuirks(quirks);
+}
+
+struct AUDIO_OUTPUT                             //--audio: synthesizer on the emulation thread, WAV writer on its own
+{
+    CHIP8_AUDIO_RING *ring;
+    CHIP8_AUDIO_SYNTH *synth;                   //NULL without --audio
+    CHIP8_WAV_SINK *sink;
+};
+
+static int startAudio(AUDIO_OUTPUT &audio, const char *filename, bool realTime)
+{
+    audio.ring = NULL;
+    audio.synth = NULL;
+    audio.sink = NULL;
+    if(filename == NULL)
+    {
+        return STATUS_SUCCESS;
+    }
+    audio.ring = new CHIP8_AUDIO_RING();        //heap allocated, the ring is too big to keep on the stack
+    audio.synth = new CHIP8_AUDIO_SYNTH(*audio.ring);
+    audio.sink = new CHIP8_WAV_SINK(*audio.ring);
+    int returnValue = audio.sink->open(filename);
+    if(returnValue != STATUS_SUCCESS)
+    {
+        cerr << "Unable to open audio file " << filename << "!" << endl;
+        delete audio.sink;
+        delete audio.synth;
+        delete audio.ring;
+        audio.ring = NULL;
+        audio.synth = NULL;
+        audio.sink = NULL;
+        return returnValue;
+    }
+    audio.sink->start(realTime);
+    return STATUS_SUCCESS;
+}
+
+static void stopAudio(AUDIO_OUTPUT &audio)
+{
+    if(audio.sink != NULL)
+    {
+        audio.sink->stop();
+        if(audio.sink->getStatus() == STATUS_SUCCESS)
+        {
+            cout << "Audio samples written: " << audio.sink->getSamplesWritten() << " of " << audio.synth->getSampleCount()
+                 << " rendered (" << audio.ring->getOverrunSamples() << " dropped on overrun, " << audio.ring->getUnderrunSamples()
+                 << " silence on underrun), audible frames: " << audio.synth->getAudibleFrames() << " of " << audio.synth->getFrameCount() << endl;
+        }
+    }
+    delete audio.sink;
+    delete audio.synth;
+    delete audio.ring;
+}
+
+static int runReplay(const char *logFilename, const char *audioFilename)
+{
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();
+    CHIP8_REPLAYER replayer;
+    AUDIO_OUTPUT audio = { NULL, NULL, NULL };
+    int returnValue = replayer.open(logFilename, *emulator);
+    if(returnValue == STATUS_SUCCESS)
+    {   //the log replays flat out, the emulator waits for the file so the capture is complete
+        returnValue = startAudio(audio, audioFilename, false);
+        replayer.setAudio(audio.synth);
+    }
+    if(returnValue == STATUS_SUCCESS)
+    {
+        unsigned long executed = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        returnValue = replayer.run(*emulator, &executed);
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        printSummary(*emulator, logFilename, returnValue == STATUS_SUCCESS ? "replay matched" : "replay failed", returnValue, executed, elapsed);
+    }
+    else if(returnValue == ERR_INVALID_REPLAY)
+    {
+        cerr << "Replay log is corrupted or from another version!" << endl;
+    }
+    stopAudio(audio);
+    delete emulator;
+    return returnValue;
+}
+
+int main(int argc, char *argv[])
+{
+    // char TESTFILENAME[] = "Breakout.ch8";
+    char romFilename[MAX_FILENAME_LEN] = "test_vector.ch8";
+    bool headless = false;
+    bool useBlocks = false;
+    bool differential = false;
+    bool realTime = false;
+    bool idleSkip = true;
+    bool predecode = false;
+    unsigned int platform = PLATFORM_CHIP8;
+    bool quirksGiven = false;
+    unsigned int quirks = QUIRKS_DEFAULT;
+    const char *quirkDatabase = NULL;
+    const char *profilePrefix = NULL;
+    const char *framePrefix = NULL;
+    const char *audioFilename = NULL;
+    unsigned int profileSamplePeriod = 1;
+    unsigned long cpuClock = DEFAULT_CPU_CLOCK;
+    unsigned long cycleBudget = (unsigned long) -1;
+    double secondsBudget = 0.0;
+    bool seedGiven = false;
+    unsigned long long seed = 0;
+    const char *batchManifest = NULL;
+    bool deduplicate = false;
+    unsigned int threadCount = 0;
+    unsigned int lockstepCount = 0;
+    unsigned int sessionCount = 0;
+    unsigned int sessionQuota = 0;
+    const char *recordFilename = NULL;
+    const char *replayFilename = NULL;
+    const char *inputSource = NULL;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+        }
+        else if(strncmp(argv[i], "--cycles=", 9) == 0)
+        {
+            cycleBudget = strtoul(argv[i] + 9, NULL, 0);
+            headless = true;
+        }
+        else if(strncmp(argv[i], "--seconds=", 10) == 0)
+        {
+            secondsBudget = atof(argv[i] + 10);
+            headless = true;
+        }
+        else if(strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            seed = strtoull(argv[i] + 7, NULL, 0);
+            seedGiven = true;
+        }
+        else if(strncmp(argv[i], "--clock=", 8) == 0)
+        {
+            cpuClock = strtoul(argv[i] + 8, NULL, 0);
+            if(cpuClock == 0)
+            {
+                printUsage(argv[0]);
+                return ERR_INVALID_ARGUMENT;
+            }
+        }
+        else if(strcmp(argv[i], "--realtime") == 0)
+        {
+            realTime = true;
+        }
+        else if(strncmp(argv[i], "--profile=", 10) == 0)
+        {
+#ifndef CHIP8_ENABLE_PROFILE
+            cerr << "Profiling is not compiled in, rebuild with 'make PROFILE=1'" << endl;
+            return ERR_INVALID_ARGUMENT;
+#endif
+            profilePrefix = argv[i] + 10;
+        }
+        else if(strncmp(argv[i], "--profile-sample=", 17) == 0)
+        {
+            profileSamplePeriod = strtoul(argv[i] + 17, NULL, 0);
+        }
+        else if(strcmp(argv[i], "--no-idle-skip") == 0)
+        {
+            idleSkip = false;
+        }
+        else if(strcmp(argv[i], "--predecode") == 0)
+        {
+            predecode = true;
+        }
+        else if(strncmp(argv[i], "--platform=", 11) == 0)
+        {
+            if(parsePlatform(argv[i] + 11, &platform) != STATUS_SUCCESS)
+            {
+                printUsage(argv[0]);
+                return ERR_INVALID_ARGUMENT;
+            }
+        }
+        else if(strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            if(parseQuirks(argv[i] + 9, &quirks) != STATUS_SUCCESS)
+            {
+                printUsage(argv[0]);
+                return ERR_INVALID_ARGUMENT;
+            }
+            quirksGiven = true;
+        }
+        else if(strncmp(argv[i], "--quirk-db=", 11) == 0)
+        {
+            quirkDatabase = argv[i] + 11;
+        }
+        else if(strncmp(argv[i], "--dump-frames=", 14) == 0)
+        {
+            framePrefix = argv[i] + 14;
+        }
+        else if(strncmp(argv[i], "--audio=", 8) == 0)
+        {
+            audioFilename = argv[i] + 8;
+        }
+        else if(strcmp(argv[i], "--blocks") == 0)
+        {
+            useBlocks = true;
+        }
+        else if(strcmp(argv[i], "--diff") == 0)
+        {
+            useBlocks = true;
+            differential = true;
+        }
+        else if(strncmp(argv[i], "--batch=", 8) == 0)
+        {
+            batchManifest = argv[i] + 8;
+        }
+        else if(strcmp(argv[i], "--dedup") == 0)
+        {
+            deduplicate = true;
+        }
+        else if(strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            threadCount = strtoul(argv[i] + 10, NULL, 0);
+        }
+        else if(strncmp(argv[i], "--lockstep=", 11) == 0)
+        {
+            lockstepCount = strtoul(argv[i] + 11, NULL, 0);
+        }
+        else if(strncmp(argv[i], "--sessions=", 11) == 0)
+        {
+            sessionCount = strtoul(argv[i] + 11, NULL, 0);
+        }
+        else if(strncmp(argv[i], "--session-quota=", 16) == 0)
+        {
+            sessionQuota = strtoul(argv[i] + 16, NULL, 0);
+        }
+        else if(strncmp(argv[i], "--input=", 8) == 0)
+        {
+            inputSource = argv[i] + 8;
+        }
+        else if(strncmp(argv[i], "--record=", 9) == 0)
+        {
+            recordFilename = argv[i] + 9;
+            headless = true;
+        }
+        else if(strncmp(argv[i], "--replay=", 9) == 0)
+        {
+            replayFilename = argv[i] + 9;
+        }
+        else if(argv[i][0] == '-')
+        {
+            printUsage(argv[0]);
+            return ERR_INVALID_ARGUMENT;
+        }
+        else
+        {
+            strncpy(romFilename, argv[i], MAX_FILENAME_LEN - 1);
+            romFilename[MAX_FILENAME_LEN - 1] = '\0';
+        }
+    }
+
+    if(!quirksGiven)
+    {   //a database hit still wins over this
+        quirks = getPlatformQuirks(platform);
+    }
+
+    if(replayFilename != NULL)
+    {
+        return runReplay(replayFilename, audioFilename);
+    }
+
+    if(batchManifest != NULL)
+    {
+        if(deduplicate && useBlocks)
+        {   //blocks may run past a checkpoint, so states are only compared on the interpreter
+            cerr << "--dedup runs jobs on the interpreter, it cannot be combined with --blocks" << endl;
+            return ERR_INVALID_ARGUMENT;
+        }
+        return runBatch(batchManifest, threadCount, useBlocks, deduplicate);
+    }
+
+    if(lockstepCount > 0)
+    {
+        return runLockstep(romFilename, lockstepCount, cycleBudget == (unsigned long) -1 ? DEFAULT_BATCH_CYCLES : cycleBudget);
+    }
+
+    if(sessionCount > 0)
+    {
+        SESSION_CONFIG config = { platform, quirks, 0, cpuClock, sessionQuota, 0, -1 };
+        return runSessions(romFilename, sessionCount, threadCount, config, secondsBudget > 0.0 ? secondsBudget : DEFAULT_SESSION_SECONDS);
+    }
+
+    CHIP8_EMULATOR *emulator = new CHIP8_EMULATOR();   //heap allocated, the decode caches are too big to keep on the stack
+    emulator->initEmulator();
+    emulator->setPlatform(platform);    //before the ROM, it sets the size of memory
+    if(emulator->loadROM(romFilename) != STATUS_SUCCESS)
+    {
+        delete emulator;
+        return ERR_UNABLE_OPEN_FILE;
+    }
+    if(selectQuirks(*emulator, romFilename, quirkDatabase, quirksGiven, quirks) != STATUS_SUCCESS)
+    {
+        delete emulator;
+        return ERR_INVALID_ARGUMENT;
+    }
+    emulator->setDifferentialCheck(differential);
+    emulator->setIdleSkip(idleSkip);
+    if(headless || seedGiven)
+    {   //headless summaries and hashes must not change between identical invocations
+        emulator->seedRNG(seed);
+    }
+    if(predecode)
+    {   //after quirks and idle skip, both change what an instruction decodes to
+        CHIP8_ANALYZER analyzer;
+        CHIP8_ROM_ANALYSIS analysis;
+        if(analyzer.analyze(romFilename, platform, analysis) == STATUS_SUCCESS)
+        {
+            emulator->predecode(analysis.instructions);
+        }
+    }
+    CHIP8_KEYPAD *keypad = NULL;
+    if(inputSource != NULL)
+    {
+        keypad = new CHIP8_KEYPAD();
+        if(keypad->open(inputSource) != STATUS_SUCCESS)
+        {
+            printUsage(argv[0]);
+            delete keypad;
+            delete emulator;
+            return ERR_INVALID_ARGUMENT;
+        }
+        keypad->start();
+    }
+    CHIP8_PROFILER *profiler = NULL;
+    if(profilePrefix != NULL)
+    {
+        profiler = new CHIP8_PROFILER(profileSamplePeriod);
+        emulator->setProfiler(profiler);
+    }
+
+    CHIP8_SCHEDULER scheduler(*emulator);
+    scheduler.setClock(cpuClock);
+    scheduler.setUseBlocks(useBlocks);
+    CHIP8_TRIPLE_BUFFER *display = NULL;
+    CHIP8_FRAME_DUMPER *dumper = NULL;
+    if(framePrefix != NULL)
+    {   //heap allocated, three hi-res frames are too big to keep on the stack
+        display = new CHIP8_TRIPLE_BUFFER();
+        dumper = new CHIP8_FRAME_DUMPER(*display, framePrefix);
+        scheduler.setDisplay(display);
+        dumper->start();
+    }
+    AUDIO_OUTPUT audio = { NULL, NULL, NULL };
+    int returnValue = startAudio(audio, audioFilename, realTime || !headless);   //paced runs are sampled like a sound card would
+    scheduler.setAudio(audio.synth);
+    if(returnValue == STATUS_SUCCESS && headless)
+    {
+        scheduler.setRealTime(realTime);
+        returnValue = runHeadless(*emulator, scheduler, keypad, romFilename, cycleBudget, secondsBudget, realTime, recordFilename);
+    }
+    else if(returnValue == STATUS_SUCCESS)
+    {
+        scheduler.setRealTime(true);    //one frame of instructions, then sleep until the next 60hz deadline
+        CHIP8_RECORDER recorder;        //never opened, it only applies the input
+        FRAME_INPUT input = { &recorder, keypad };
+        scheduler.setTimerTickHandler(frameBoundary, &input);
+        while(returnValue == STATUS_SUCCESS)
+        {
+            unsigned long long executed = 0;
+            returnValue = scheduler.runFrame(&executed);
+            CHIP8_TRACE("Frame " << scheduler.getFrameCount() << ", emulator cycle count: " << scheduler.getInstructionCount());
+        }
+        if(returnValue == STATUS_PROGRAM_EXIT)
+        {
+            cout << "Program exited" << endl;
+            returnValue = STATUS_SUCCESS;
+        }
+        else if(returnValue == ERR_INVALID_OPCODE)
+        {
+            cerr << "Unrecognized opcode: 0x" << hex << emulator->getInvalidOpcode() << dec << endl;
+        }
+        else
+        {
+            cerr << "Emulator stopped with error " << returnValue << endl;
+        }
+    }
+
+    if(keypad != NULL)
+    {
+        keypad->stop();     //puts the terminal back
+        if(keypad->getDroppedEvents() > 0)
+        {
+            cerr << "Keypad events dropped (queue full): " << keypad->getDroppedEvents() << endl;
+        }
+        delete keypad;
+    }
+
+    if(dumper != NULL)
+    {
+        dumper->stop();
+        cout << "Frames dumped: " << dumper->getFramesWritten() << " of " << display->getPublishedCount() << " published ("
+             << display->getDroppedCount() << " replaced before the dumper took them), rows copied: " << display->getCopiedRows()
+             << ", rows converted: " << dumper->getRowsConverted() << endl;
+        delete dumper;
+        delete display;
+    }
+    stopAudio(audio);
+
+    if(profiler != NULL)
+    {
+        emulator->setProfiler(NULL);
+        writeProfile(*profiler, profilePrefix);
+        delete profiler;
+    }
+
+    delete emulator;
+    return returnValue;
+}